@@ -0,0 +1,476 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include "CompressedPostings.h"
+#include "Date.h"
+#include "MemoryReport.h"
+#include <string>
+#include <tuple>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+using std::pair;
+using std::string;
+using std::unordered_map;
+using std::vector;
+
+// Keyword attributes that can be counted per value (facets)
+enum class Facet { Genre, Developer, Publisher };
+
+constexpr size_t RATING_HISTOGRAM_BINS = 24; // bin b holds positive ratings in [2^(b-1), 2^b), bin 0 holds 0
+
+/*
+* Measures of one (value, month) cell, or of a whole month in the totals
+*	Stored at 32 bits: a cell only holds the releases of one month. The histogram of positive ratings is what
+*	medians and percentiles are estimated from, its bins saturate at UINT16_MAX.
+*/
+struct CubeCell {
+	uint32_t count = 0;
+	uint32_t positive_sum = 0, positive_min = UINT32_MAX, positive_max = 0;
+	uint32_t negative_sum = 0, negative_min = UINT32_MAX, negative_max = 0;
+	uint32_t price_sum = 0, price_min = UINT32_MAX, price_max = 0; // cents
+	uint16_t histogram[RATING_HISTOGRAM_BINS] = {};
+
+	static size_t bin_of(uint32_t ratings) {
+		size_t bin = 0;
+		while (ratings != 0 && bin + 1 < RATING_HISTOGRAM_BINS) {
+			ratings >>= 1;
+			++bin;
+		}
+		return bin;
+	}
+
+	void add(uint32_t positive, uint32_t negative, uint32_t price_cents) {
+		++count;
+		positive_sum += positive;
+		positive_min = std::min(positive_min, positive);
+		positive_max = std::max(positive_max, positive);
+		negative_sum += negative;
+		negative_min = std::min(negative_min, negative);
+		negative_max = std::max(negative_max, negative);
+		price_sum += price_cents;
+		price_min = std::min(price_min, price_cents);
+		price_max = std::max(price_max, price_cents);
+		uint16_t& bin = histogram[bin_of(positive)];
+		bin += (bin != UINT16_MAX);
+	}
+
+	/*
+	* Takes back one add(), returns true if a min or max may have belonged to it
+	*	Sums, count and histogram are exact (a saturated bin stays saturated). Min and max can't be taken back, so a
+	*	cell that returns true holds stale bounds until it's recounted. A cell that empties starts over clean.
+	*/
+	bool remove(uint32_t positive, uint32_t negative, uint32_t price_cents) {
+		--count;
+		positive_sum -= positive;
+		negative_sum -= negative;
+		price_sum -= price_cents;
+		uint16_t& bin = histogram[bin_of(positive)];
+		bin -= (bin != UINT16_MAX && bin != 0);
+		if (count == 0) {
+			*this = CubeCell();
+			return false;
+		}
+		return positive == positive_min || positive == positive_max || negative == negative_min || negative == negative_max
+			|| price_cents == price_min || price_cents == price_max;
+	}
+};
+
+// Roll-up of any number of cells, the answer to a cube query
+struct Aggregate {
+	struct Stat {
+		uint64_t sum = 0;
+		uint32_t min = UINT32_MAX;	// UINT32_MAX / 0 while count is 0
+		uint32_t max = 0;
+	};
+
+	uint64_t count = 0;
+	Stat positive;
+	Stat negative;
+	Stat price_cents;
+	uint64_t histogram[RATING_HISTOGRAM_BINS] = {};
+
+	void merge(const CubeCell& cell) {
+		count += cell.count;
+		merge(positive, cell.positive_sum, cell.positive_min, cell.positive_max);
+		merge(negative, cell.negative_sum, cell.negative_min, cell.negative_max);
+		merge(price_cents, cell.price_sum, cell.price_min, cell.price_max);
+		for (size_t b = 0; b < RATING_HISTOGRAM_BINS; ++b) {
+			histogram[b] += cell.histogram[b];
+		}
+	}
+
+	double mean(const Stat& stat) const {
+		return (count == 0) ? 0.0 : double(stat.sum) / count;
+	}
+
+	// Positive ratings at quantile q (0.5 = median), interpolated inside a power-of-two bin
+	double positive_quantile(double q) const {
+		uint64_t total = 0;
+		for (uint64_t bin : histogram) {
+			total += bin;
+		}
+		if (total == 0) {
+			return 0.0;
+		}
+		double rank = q * (total - 1);
+		uint64_t seen = 0;
+		for (size_t b = 0; b < RATING_HISTOGRAM_BINS; ++b) {
+			if (histogram[b] == 0 || seen + histogram[b] <= rank) {
+				seen += histogram[b];
+				continue;
+			}
+			if (b == 0) {
+				return 0.0;
+			}
+			double lo = std::max<double>(double(uint64_t(1) << (b - 1)), positive.min);
+			double hi = std::min<double>(double(uint64_t(1) << b) - 1, positive.max);
+			double fraction = (histogram[b] == 1) ? 0.5 : (rank - seen) / (histogram[b] - 1);
+			return lo + fraction * (std::max(hi, lo) - lo);
+		}
+		return positive.max;
+	}
+
+	double positive_median() const {
+		return positive_quantile(0.5);
+	}
+
+private:
+
+	static void merge(Stat& stat, uint32_t sum, uint32_t min, uint32_t max) {
+		stat.sum += sum;
+		stat.min = std::min(stat.min, min);
+		stat.max = std::max(stat.max, max);
+	}
+};
+
+/*
+* Materialized (month x genre/developer/publisher) aggregates
+*	add() runs once per game and key while the library loads, finalize() lays the cells of each dimension out
+*	sorted by (key id, month) with an offset per key, so a key's time series is one contiguous slice. Queries
+*	only read cells: total() rolls a month range up, series() drills down to months or years and by_value()
+*	breaks a month range down per value. Keys are the canonical ids of the library's PostingIndexes.
+*
+*	Months are numbered year * 12 + (month - 1), see period().
+*/
+class AggregateCube {
+	struct Dimension {
+		const PostingIndex* index = nullptr;
+		unordered_map<uint64_t, CubeCell> pending;	// (key << 16 | period) -> cell, while loading
+		vector<uint32_t> key_offsets;				// cells of key k are [key_offsets[k], key_offsets[k + 1])
+		vector<uint16_t> periods;
+		vector<CubeCell> cells;
+	};
+
+	Dimension dimensions[3];	// indexed by Facet
+	vector<uint16_t> total_periods;
+	vector<CubeCell> totals;	// every game, one cell per month
+	unordered_map<uint16_t, CubeCell> pending_totals;
+
+public:
+
+	enum class Granularity { Month, Year };
+
+	// A cell remove() left with stale bounds, total = a cell of the per-month totals (facet and key unused)
+	struct CellRef {
+		bool total;
+		Facet facet;
+		uint32_t key;
+		uint16_t period;
+	};
+
+private:
+
+	vector<CellRef> stale;	// see remove()
+
+public:
+
+	AggregateCube(const PostingIndex& genres, const PostingIndex& developers, const PostingIndex& publishers) {
+		dimensions[static_cast<int>(Facet::Genre)].index = &genres;
+		dimensions[static_cast<int>(Facet::Developer)].index = &developers;
+		dimensions[static_cast<int>(Facet::Publisher)].index = &publishers;
+	}
+
+	// An AggregateCube points at its library's indexes, it can't follow a copy
+	AggregateCube(const AggregateCube&) = delete;
+	AggregateCube& operator=(const AggregateCube&) = delete;
+
+	static uint16_t period(unsigned int year, unsigned int month) {
+		return static_cast<uint16_t>(year * 12 + (month - 1));
+	}
+
+	static uint16_t period(const Date& d) {
+		return period(d.get_year(), d.get_month());
+	}
+
+	static unsigned int year_of(uint16_t period) {
+		return period / 12;
+	}
+
+	static unsigned int month_of(uint16_t period) {
+		return period % 12 + 1;
+	}
+
+	// Counts one game under every key in key_ids (canonical ids, duplicates are ignored)
+	void add(Facet facet, vector<uint32_t> key_ids, const Date& release, uint32_t positive, uint32_t negative, uint32_t price_cents) {
+		std::sort(key_ids.begin(), key_ids.end());
+		key_ids.erase(std::unique(key_ids.begin(), key_ids.end()), key_ids.end());
+		uint64_t p = period(release);
+		for (const uint32_t& key : key_ids) {
+			if (key != PostingIndex::NO_KEY) {
+				dimensions[static_cast<int>(facet)].pending[(uint64_t(key) << 16) | p].add(positive, negative, price_cents);
+			}
+		}
+	}
+
+	// Counts one game in the per-month totals, call once per game
+	void add_total(const Date& release, uint32_t positive, uint32_t negative, uint32_t price_cents) {
+		pending_totals[period(release)].add(positive, negative, price_cents);
+	}
+
+	/*
+	* Takes one game back out of finalized cells, the inverse of add() for a game that's deleted or changed
+	*	Cells whose min or max may have been the game's are listed in take_stale(), the caller recounts them from
+	*	the rows of that month and puts them back with replace(). Cells that empty are dropped by finalize().
+	*/
+	void remove(Facet facet, const vector<uint32_t>& key_ids, const Date& release, uint32_t positive, uint32_t negative, uint32_t price_cents) {
+		Dimension& dim = dimensions[static_cast<int>(facet)];
+		uint16_t p = period(release);
+		for (const uint32_t& key : key_ids) {
+			CubeCell* cell = find_cell(dim, key, p);
+			if (cell != nullptr && cell->count > 0 && cell->remove(positive, negative, price_cents)) {
+				stale.push_back({ false, facet, key, p });
+			}
+		}
+	}
+
+	void remove_total(const Date& release, uint32_t positive, uint32_t negative, uint32_t price_cents) {
+		uint16_t p = period(release);
+		auto iter = std::lower_bound(total_periods.begin(), total_periods.end(), p);
+		if (iter != total_periods.end() && *iter == p) {
+			CubeCell& cell = totals[iter - total_periods.begin()];
+			if (cell.count > 0 && cell.remove(positive, negative, price_cents)) {
+				stale.push_back({ true, Facet::Genre, 0, p });
+			}
+		}
+	}
+
+	// Cells with stale bounds since the last call, each listed once
+	vector<CellRef> take_stale() {
+		vector<CellRef> cells = std::move(stale);
+		stale.clear();
+		auto order = [](const CellRef& a, const CellRef& b) {
+			return std::make_tuple(a.total, a.facet, a.key, a.period) < std::make_tuple(b.total, b.facet, b.key, b.period);
+		};
+		auto same = [](const CellRef& a, const CellRef& b) {
+			return a.total == b.total && a.facet == b.facet && a.key == b.key && a.period == b.period;
+		};
+		std::sort(cells.begin(), cells.end(), order);
+		cells.erase(std::unique(cells.begin(), cells.end(), same), cells.end());
+		return cells;
+	}
+
+	// Overwrites a finalized cell with a recount, after finalize() so the recount covers games added since
+	void replace(const CellRef& ref, const CubeCell& recount) {
+		if (ref.total) {
+			auto iter = std::lower_bound(total_periods.begin(), total_periods.end(), ref.period);
+			if (iter != total_periods.end() && *iter == ref.period) {
+				totals[iter - total_periods.begin()] = recount;
+			}
+			return;
+		}
+		CubeCell* cell = find_cell(dimensions[static_cast<int>(ref.facet)], ref.key, ref.period);
+		if (cell != nullptr) {
+			*cell = recount;
+		}
+	}
+
+	// Drops every cell, e.g. before recounting a reloaded catalog
+	void clear() {
+		for (Dimension& dim : dimensions) {
+			const PostingIndex* index = dim.index;
+			dim = Dimension();
+			dim.index = index;
+		}
+		total_periods = vector<uint16_t>();
+		totals = vector<CubeCell>();
+		pending_totals = unordered_map<uint16_t, CubeCell>();
+		stale.clear();
+	}
+
+	// Merges everything added so far into the sorted layout, can be called again after more add()s or remove()s
+	void finalize() {
+		for (Dimension& dim : dimensions) {
+			unpack(dim);
+			vector<pair<uint64_t, CubeCell>> sorted;
+			sorted.reserve(dim.pending.size());
+			for (const auto& entry : dim.pending) {
+				if (entry.second.count > 0) { // remove() emptied it
+					sorted.push_back(entry);
+				}
+			}
+			dim.pending = unordered_map<uint64_t, CubeCell>();
+			std::sort(sorted.begin(), sorted.end(), [](const pair<uint64_t, CubeCell>& a, const pair<uint64_t, CubeCell>& b) {
+				return a.first < b.first;
+			});
+
+			size_t num_keys = dim.index->size();
+			dim.key_offsets.assign(num_keys + 1, 0);
+			dim.periods.clear();
+			dim.cells.clear();
+			dim.periods.reserve(sorted.size());
+			dim.cells.reserve(sorted.size());
+			for (const auto& entry : sorted) {
+				++dim.key_offsets[(entry.first >> 16) + 1];
+				dim.periods.push_back(static_cast<uint16_t>(entry.first & 0xFFFF));
+				dim.cells.push_back(entry.second);
+			}
+			for (size_t k = 0; k < num_keys; ++k) {
+				dim.key_offsets[k + 1] += dim.key_offsets[k];
+			}
+		}
+
+		for (size_t i = 0; i < totals.size(); ++i) {
+			CubeCell& cell = pending_totals[total_periods[i]];
+			cell = merged(cell, totals[i]);
+		}
+		vector<pair<uint16_t, CubeCell>> sorted;
+		sorted.reserve(pending_totals.size());
+		for (const auto& entry : pending_totals) {
+			if (entry.second.count > 0) {
+				sorted.push_back(entry);
+			}
+		}
+		pending_totals = unordered_map<uint16_t, CubeCell>();
+		std::sort(sorted.begin(), sorted.end(), [](const pair<uint16_t, CubeCell>& a, const pair<uint16_t, CubeCell>& b) {
+			return a.first < b.first;
+		});
+		total_periods.clear();
+		totals.clear();
+		for (const auto& entry : sorted) {
+			total_periods.push_back(entry.first);
+			totals.push_back(entry.second);
+		}
+	}
+
+	// Every game released in months [lo, hi] (value empty) or every game of one value
+	Aggregate total(Facet facet, const string& value, uint16_t lo, uint16_t hi) const {
+		Aggregate result;
+		for_each_cell(facet, value, lo, hi, [&](uint16_t, const CubeCell& cell) { result.merge(cell); });
+		return result;
+	}
+
+	Aggregate total(uint16_t lo, uint16_t hi) const {
+		return total(Facet::Genre, "", lo, hi);
+	}
+
+	// One aggregate per month (or year) in [lo, hi] that has releases, value empty means every game
+	vector<pair<uint16_t, Aggregate>> series(Facet facet, const string& value, uint16_t lo, uint16_t hi,
+		Granularity granularity = Granularity::Month) const {
+		vector<pair<uint16_t, Aggregate>> result;
+		for_each_cell(facet, value, lo, hi, [&](uint16_t p, const CubeCell& cell) {
+			uint16_t bucket = (granularity == Granularity::Year) ? period(year_of(p), 1) : p;
+			if (result.empty() || result.back().first != bucket) {
+				result.emplace_back(bucket, Aggregate());
+			}
+			result.back().second.merge(cell);
+		});
+		return result;
+	}
+
+	// One aggregate per value of facet with releases in [lo, hi], in key order
+	vector<pair<string, Aggregate>> by_value(Facet facet, uint16_t lo, uint16_t hi) const {
+		const Dimension& dim = dimensions[static_cast<int>(facet)];
+		vector<pair<string, Aggregate>> result;
+		for (size_t key = 0; key + 1 < dim.key_offsets.size(); ++key) {
+			Aggregate aggregate;
+			slice(dim, key, lo, hi, [&](uint16_t, const CubeCell& cell) { aggregate.merge(cell); });
+			if (aggregate.count > 0) {
+				result.emplace_back(dim.index->get_keys()[key], aggregate);
+			}
+		}
+		return result;
+	}
+
+	size_t num_cells() const {
+		size_t cells = totals.size();
+		for (const Dimension& dim : dimensions) {
+			cells += dim.cells.size();
+		}
+		return cells;
+	}
+
+	size_t memory_bytes() const {
+		size_t bytes = memory_usage::of(total_periods) + memory_usage::of(totals);
+		for (const Dimension& dim : dimensions) {
+			bytes += memory_usage::of(dim.key_offsets) + memory_usage::of(dim.periods) + memory_usage::of(dim.cells);
+		}
+		return bytes;
+	}
+
+private:
+
+	// Moves finalized cells back into pending so a later finalize() can merge new add()s into them
+	static void unpack(Dimension& dim) {
+		for (size_t key = 0; key + 1 < dim.key_offsets.size(); ++key) {
+			for (uint32_t c = dim.key_offsets[key]; c < dim.key_offsets[key + 1]; ++c) {
+				CubeCell& cell = dim.pending[(uint64_t(key) << 16) | dim.periods[c]];
+				cell = merged(cell, dim.cells[c]);
+			}
+		}
+	}
+
+	static CubeCell merged(const CubeCell& a, const CubeCell& b) {
+		CubeCell result = a;
+		result.count += b.count;
+		result.positive_sum += b.positive_sum;
+		result.positive_min = std::min(a.positive_min, b.positive_min);
+		result.positive_max = std::max(a.positive_max, b.positive_max);
+		result.negative_sum += b.negative_sum;
+		result.negative_min = std::min(a.negative_min, b.negative_min);
+		result.negative_max = std::max(a.negative_max, b.negative_max);
+		result.price_sum += b.price_sum;
+		result.price_min = std::min(a.price_min, b.price_min);
+		result.price_max = std::max(a.price_max, b.price_max);
+		for (size_t i = 0; i < RATING_HISTOGRAM_BINS; ++i) {
+			result.histogram[i] = static_cast<uint16_t>(std::min<uint32_t>(uint32_t(a.histogram[i]) + b.histogram[i], UINT16_MAX));
+		}
+		return result;
+	}
+
+	static CubeCell* find_cell(Dimension& dim, uint32_t key, uint16_t p) {
+		if (key == PostingIndex::NO_KEY || size_t(key) + 1 >= dim.key_offsets.size()) {
+			return nullptr;
+		}
+		auto first = dim.periods.begin() + dim.key_offsets[key];
+		auto last = dim.periods.begin() + dim.key_offsets[key + 1];
+		auto iter = std::lower_bound(first, last, p);
+		return (iter != last && *iter == p) ? &dim.cells[iter - dim.periods.begin()] : nullptr;
+	}
+
+	template <typename Fn>
+	static void slice(const Dimension& dim, size_t key, uint16_t lo, uint16_t hi, Fn&& fn) {
+		auto first = dim.periods.begin() + dim.key_offsets[key];
+		auto last = dim.periods.begin() + dim.key_offsets[key + 1];
+		for (auto iter = std::lower_bound(first, last, lo); iter != last && *iter <= hi; ++iter) {
+			fn(*iter, dim.cells[iter - dim.periods.begin()]);
+		}
+	}
+
+	template <typename Fn>
+	void for_each_cell(Facet facet, const string& value, uint16_t lo, uint16_t hi, Fn&& fn) const {
+		if (value.empty()) {
+			auto first = std::lower_bound(total_periods.begin(), total_periods.end(), lo);
+			for (auto iter = first; iter != total_periods.end() && *iter <= hi; ++iter) {
+				fn(*iter, totals[iter - total_periods.begin()]);
+			}
+			return;
+		}
+		const Dimension& dim = dimensions[static_cast<int>(facet)];
+		uint32_t key = dim.index->id_of(value);
+		if (key != PostingIndex::NO_KEY && key + 1 < dim.key_offsets.size()) {
+			slice(dim, key, lo, hi, fn);
+		}
+	}
+};
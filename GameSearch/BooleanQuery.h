@@ -0,0 +1,377 @@
+#pragma once
+#include "AggregateCube.h"
+#include "CompressedPostings.h"
+#include "SetAlgebra.h"
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using std::string;
+using std::vector;
+
+/*
+* Boolean search over the keyword indexes, e.g. genre:Strategy AND NOT genre:Early Access
+*	Terms are field:value, field is genre (or tag), developer or publisher. A value runs until the next AND, OR,
+*	NOT, term or unmatched ')', or can be quoted. Operators are upper case so "Hack and Slash" stays one value.
+*	NOT binds tightest, then AND, then OR, and terms next to each other are ANDed.
+*
+*	evaluate() works on sorted appid lists. An AND intersects its terms shortest first on the compressed postings
+*	(blocks that can't match are never decoded) and subtracts its NOT terms the same way, an OR of any width is one
+*	k-way heap merge, and only a NOT outside of an AND is taken against the universe of every appid.
+*
+* Methods
+*	BooleanQuery() - parses an expression, throws std::invalid_argument if it's malformed
+*	evaluate() - sorted appids matching the expression
+*	to_string() - the parsed expression, fully parenthesized
+*/
+class BooleanQuery {
+public:
+	struct Node {
+		enum class Kind { Term, And, Or, Not };
+		Kind kind = Kind::Term;
+		Facet field = Facet::Genre;
+		string value;
+		vector<Node> children;
+	};
+
+private:
+	struct Token {
+		enum class Kind { Term, And, Or, Not, Open, Close, End };
+		Kind kind = Kind::End;
+		Facet field = Facet::Genre;
+		string value;
+	};
+
+	Node root;
+	vector<Token> tokens;
+	size_t next = 0;
+
+public:
+
+	explicit BooleanQuery(const string& expression) {
+		tokenize(expression);
+		root = parse_or();
+		if (peek() != Token::Kind::End) {
+			throw std::invalid_argument("Unexpected ')' in query");
+		}
+		tokens.clear();
+	}
+
+	const Node& get_root() const {
+		return root;
+	}
+
+	/*
+	* lookup(Facet, value) returns the CompressedPostingList of a term, nullptr if there's no such value
+	* universe() returns the sorted appids of every game, only called when a NOT needs it
+	*/
+	template <typename Lookup, typename Universe>
+	vector<appid> evaluate(Lookup lookup, Universe universe) const {
+		return evaluate(root, lookup, universe);
+	}
+
+	string to_string() const {
+		return to_string(root);
+	}
+
+private:
+
+	template <typename Lookup, typename Universe>
+	static vector<appid> evaluate(const Node& node, Lookup& lookup, Universe& universe) {
+		switch (node.kind) {
+		case Node::Kind::Term: {
+			const CompressedPostingList* postings = lookup(node.field, node.value);
+			return (postings == nullptr) ? vector<appid>() : postings->decode();
+		}
+		case Node::Kind::Not:
+			return set_algebra::complement(evaluate(node.children[0], lookup, universe), universe());
+		case Node::Kind::Or: {
+			vector<vector<appid>> lists;
+			for (const Node& child : node.children) {
+				lists.push_back(evaluate(child, lookup, universe));
+			}
+			return set_algebra::unite(lists);
+		}
+		default:
+			return evaluate_and(node, lookup, universe);
+		}
+	}
+
+	// Terms stay compressed: the running result is probed against (or subtracted from) each posting list
+	template <typename Lookup, typename Universe>
+	static vector<appid> evaluate_and(const Node& node, Lookup& lookup, Universe& universe) {
+		vector<const CompressedPostingList*> terms;
+		vector<const CompressedPostingList*> excluded_terms;
+		vector<const Node*> others;
+		vector<const Node*> excluded_others;
+
+		for (const Node& child : node.children) {
+			if (child.kind == Node::Kind::Term) {
+				const CompressedPostingList* postings = lookup(child.field, child.value);
+				if (postings == nullptr) {
+					return vector<appid>();
+				}
+				terms.push_back(postings);
+			}
+			else if (child.kind == Node::Kind::Not && child.children[0].kind == Node::Kind::Term) {
+				const CompressedPostingList* postings = lookup(child.children[0].field, child.children[0].value);
+				if (postings != nullptr) {
+					excluded_terms.push_back(postings);
+				}
+			}
+			else if (child.kind == Node::Kind::Not) {
+				excluded_others.push_back(&child.children[0]);
+			}
+			else {
+				others.push_back(&child);
+			}
+		}
+
+		vector<appid> result;
+		if (!others.empty()) {
+			vector<vector<appid>> lists;
+			for (const Node* other : others) {
+				lists.push_back(evaluate(*other, lookup, universe));
+			}
+			result = set_algebra::intersect(std::move(lists));
+			std::sort(terms.begin(), terms.end(), [](const CompressedPostingList* a, const CompressedPostingList* b) {
+				return a->size() < b->size();
+			});
+			for (size_t i = 0; i < terms.size() && !result.empty(); ++i) {
+				result = terms[i]->intersect(result);
+			}
+		}
+		else if (!terms.empty()) {
+			result = CompressedPostingList::intersect(terms);
+		}
+		else {
+			result = universe(); // only NOT terms
+		}
+
+		for (size_t i = 0; i < excluded_terms.size() && !result.empty(); ++i) {
+			result = excluded_terms[i]->difference(result);
+		}
+		for (size_t i = 0; i < excluded_others.size() && !result.empty(); ++i) {
+			result = set_algebra::difference(result, evaluate(*excluded_others[i], lookup, universe));
+		}
+		return result;
+	}
+
+	static string to_string(const Node& node) {
+		switch (node.kind) {
+		case Node::Kind::Term:
+			return string(field_name(node.field)) + ":\"" + node.value + "\"";
+		case Node::Kind::Not:
+			return "NOT " + to_string(node.children[0]);
+		default: {
+			string out = "(";
+			for (size_t i = 0; i < node.children.size(); ++i) {
+				out += (i == 0) ? "" : (node.kind == Node::Kind::And) ? " AND " : " OR ";
+				out += to_string(node.children[i]);
+			}
+			return out + ")";
+		}
+		}
+	}
+
+	static const char* field_name(Facet field) {
+		return (field == Facet::Genre) ? "genre" : (field == Facet::Developer) ? "developer" : "publisher";
+	}
+
+	// field of "genre:...", "tag:...", "developer:..." or "publisher:...", false if word doesn't start a term
+	static bool parse_field(const string& word, Facet& field) {
+		size_t colon = word.find(':');
+		if (colon == string::npos) {
+			return false;
+		}
+		string name = Game::normalize_entity(word.substr(0, colon));
+		if (name == "genre" || name == "tag") {
+			field = Facet::Genre;
+		}
+		else if (name == "developer") {
+			field = Facet::Developer;
+		}
+		else if (name == "publisher") {
+			field = Facet::Publisher;
+		}
+		else {
+			return false;
+		}
+		return true;
+	}
+
+	static bool is_operator(const string& word) {
+		return word == "AND" || word == "OR" || word == "NOT";
+	}
+
+	static bool is_space(char c) {
+		return c == ' ' || c == '\t' || c == '\r' || c == '\n';
+	}
+
+	// One word of s from pos, a ')' closes the word unless the word opened it
+	static string read_word(const string& s, size_t pos) {
+		size_t end = pos;
+		int depth = 0;
+		while (end < s.size() && !is_space(s[end])) {
+			if (s[end] == '(') {
+				++depth;
+			}
+			else if (s[end] == ')' && depth-- == 0) {
+				break;
+			}
+			++end;
+		}
+		return s.substr(pos, end - pos);
+	}
+
+	void tokenize(const string& s) {
+		size_t pos = 0;
+		while (true) {
+			while (pos < s.size() && is_space(s[pos])) {
+				++pos;
+			}
+			Token token;
+			if (pos == s.size()) {
+				tokens.push_back(token);
+				return;
+			}
+			if (s[pos] == '(' || s[pos] == ')') {
+				token.kind = (s[pos] == '(') ? Token::Kind::Open : Token::Kind::Close;
+				tokens.push_back(token);
+				++pos;
+				continue;
+			}
+
+			string word = read_word(s, pos);
+			if (is_operator(word)) {
+				token.kind = (word == "AND") ? Token::Kind::And : (word == "OR") ? Token::Kind::Or : Token::Kind::Not;
+				tokens.push_back(token);
+				pos += word.size();
+				continue;
+			}
+			if (!parse_field(word, token.field)) {
+				throw std::invalid_argument("Expected genre:, developer: or publisher: before \"" + word + "\"");
+			}
+
+			token.kind = Token::Kind::Term;
+			pos = s.find(':', pos) + 1;
+			if (pos < s.size() && s[pos] == '"') {
+				size_t close = s.find('"', pos + 1);
+				if (close == string::npos) {
+					throw std::invalid_argument("Missing closing quote in query");
+				}
+				token.value = s.substr(pos + 1, close - pos - 1);
+				pos = close + 1;
+			}
+			else {
+				pos = read_value(s, pos, token.value);
+			}
+			if (Game::normalize_entity(token.value).empty()) {
+				throw std::invalid_argument("Missing value after " + string(field_name(token.field)) + ":");
+			}
+			tokens.push_back(token);
+		}
+	}
+
+	// Unquoted value: words up to an operator, the next term or an unmatched ')', returns where it stopped
+	static size_t read_value(const string& s, size_t pos, string& value) {
+		while (pos < s.size()) {
+			size_t word_begin = pos;
+			while (word_begin < s.size() && is_space(s[word_begin])) {
+				++word_begin;
+			}
+			string word = read_word(s, word_begin);
+			size_t unbracketed = word.find_first_not_of('(');
+			Facet ignored;
+			if (word.empty() || is_operator(word)
+				|| (unbracketed != string::npos && !value.empty() && parse_field(word.substr(unbracketed), ignored))) {
+				return word_begin;
+			}
+			value += (value.empty() || word_begin == pos) ? "" : " ";
+			value += word;
+			pos = word_begin + word.size();
+		}
+		return pos;
+	}
+
+	Token::Kind peek() const {
+		return tokens[next].kind;
+	}
+
+	Node parse_or() {
+		Node node;
+		node.kind = Node::Kind::Or;
+		add_child(node, parse_and());
+		while (peek() == Token::Kind::Or) {
+			++next;
+			add_child(node, parse_and());
+		}
+		return unwrap(std::move(node));
+	}
+
+	Node parse_and() {
+		Node node;
+		node.kind = Node::Kind::And;
+		add_child(node, parse_unary());
+		while (true) {
+			if (peek() == Token::Kind::And) {
+				++next;
+			}
+			else if (peek() != Token::Kind::Not && peek() != Token::Kind::Open && peek() != Token::Kind::Term) {
+				break;
+			}
+			add_child(node, parse_unary());
+		}
+		return unwrap(std::move(node));
+	}
+
+	Node parse_unary() {
+		Token& token = tokens[next];
+		switch (token.kind) {
+		case Token::Kind::Not: {
+			++next;
+			Node child = parse_unary();
+			if (child.kind == Node::Kind::Not) {
+				return std::move(child.children[0]); // NOT NOT x
+			}
+			Node node;
+			node.kind = Node::Kind::Not;
+			node.children.push_back(std::move(child));
+			return node;
+		}
+		case Token::Kind::Open: {
+			++next;
+			Node node = parse_or();
+			if (peek() != Token::Kind::Close) {
+				throw std::invalid_argument("Missing ')' in query");
+			}
+			++next;
+			return node;
+		}
+		case Token::Kind::Term: {
+			++next;
+			Node node;
+			node.field = token.field;
+			node.value = std::move(token.value);
+			return node;
+		}
+		default:
+			throw std::invalid_argument("Expected a term in query");
+		}
+	}
+
+	// (a AND (b AND c)) is (a AND b AND c), so a wide OR/AND is one n-way operation
+	static void add_child(Node& parent, Node child) {
+		if (child.kind == parent.kind && child.kind != Node::Kind::Term) {
+			for (Node& grandchild : child.children) {
+				parent.children.push_back(std::move(grandchild));
+			}
+			return;
+		}
+		parent.children.push_back(std::move(child));
+	}
+
+	static Node unwrap(Node node) {
+		return (node.children.size() == 1) ? std::move(node.children[0]) : std::move(node);
+	}
+};
@@ -0,0 +1,635 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include "FlatHashMap.h"
+#include "GameDescriptors.h"
+#include <iterator>
+#include "MemoryReport.h"
+#include <memory>
+#include "Simd.h"
+#include <string>
+#include <string_view>
+#include <vector>
+
+using std::string;
+using std::string_view;
+using std::unique_ptr;
+using std::vector;
+
+constexpr size_t POSTING_BLOCK_SIZE = 128;
+constexpr size_t INLINE_POSTINGS = 2;	// most developers/publishers have one or two games, those lists never touch the heap
+
+/*
+* Sorted list of appids stored as delta-encoded, bit-packed blocks of POSTING_BLOCK_SIZE ids
+*	Every block keeps its first/last id (skip metadata) and the bit width of its largest delta. Full blocks use
+*	the 4-lane vertical layout from SIMD-BP128 so SSE2 can unpack four deltas per instruction; the trailing
+*	partial block is packed horizontally. Delta 0 of each block is always 0, so decoding is unpack + prefix sum
+*	seeded with the block's first id.
+*
+*	data holds BLOCK_HEADER_WORDS per block (first, last, offset of the packed words, bits | count << 8)
+*	followed by the packed words, in a single allocation.
+*/
+class CompressedPostingList {
+	static constexpr size_t BLOCK_HEADER_WORDS = 4;
+
+	uint32_t num_ids = 0;
+	uint32_t num_data_words = 0;
+	appid inline_ids[INLINE_POSTINGS] = {};
+	unique_ptr<uint32_t[]> data;
+
+public:
+
+	CompressedPostingList() {}
+
+	// sorted_ids must be sorted and free of duplicates
+	explicit CompressedPostingList(const vector<appid>& sorted_ids) : num_ids(static_cast<uint32_t>(sorted_ids.size())) {
+		if (sorted_ids.size() <= INLINE_POSTINGS) {
+			std::copy(sorted_ids.begin(), sorted_ids.end(), inline_ids);
+			return;
+		}
+
+		size_t num_blocks = (sorted_ids.size() + POSTING_BLOCK_SIZE - 1) / POSTING_BLOCK_SIZE;
+		vector<uint32_t> words(num_blocks * BLOCK_HEADER_WORDS);
+		uint32_t deltas[POSTING_BLOCK_SIZE];
+		for (size_t b = 0; b < num_blocks; ++b) {
+			size_t start = b * POSTING_BLOCK_SIZE;
+			size_t count = std::min(POSTING_BLOCK_SIZE, sorted_ids.size() - start);
+
+			uint32_t max_delta = 0;
+			deltas[0] = 0;
+			for (size_t i = 1; i < count; ++i) {
+				deltas[i] = sorted_ids[start + i] - sorted_ids[start + i - 1];
+				max_delta = std::max(max_delta, deltas[i]);
+			}
+			uint32_t bits = bit_width(max_delta);
+
+			words[BLOCK_HEADER_WORDS * b] = sorted_ids[start];
+			words[BLOCK_HEADER_WORDS * b + 1] = sorted_ids[start + count - 1];
+			words[BLOCK_HEADER_WORDS * b + 2] = static_cast<uint32_t>(words.size());
+			words[BLOCK_HEADER_WORDS * b + 3] = bits | static_cast<uint32_t>(count) << 8;
+			if (count == POSTING_BLOCK_SIZE) {
+				pack_vertical(words, deltas, bits);
+			}
+			else {
+				pack_horizontal(words, deltas, count, bits);
+			}
+		}
+
+		num_data_words = static_cast<uint32_t>(words.size());
+		data.reset(new uint32_t[words.size()]);
+		std::copy(words.begin(), words.end(), data.get());
+	}
+
+	CompressedPostingList(const CompressedPostingList& rhs)
+		: num_ids(rhs.num_ids), num_data_words(rhs.num_data_words) {
+		std::copy(rhs.inline_ids, rhs.inline_ids + INLINE_POSTINGS, inline_ids);
+		if (rhs.data) {
+			data.reset(new uint32_t[num_data_words]);
+			std::copy(rhs.data.get(), rhs.data.get() + num_data_words, data.get());
+		}
+	}
+
+	CompressedPostingList(CompressedPostingList&&) = default;
+
+	CompressedPostingList& operator=(CompressedPostingList rhs) {
+		num_ids = rhs.num_ids;
+		num_data_words = rhs.num_data_words;
+		std::copy(rhs.inline_ids, rhs.inline_ids + INLINE_POSTINGS, inline_ids);
+		data = std::move(rhs.data);
+		return *this;
+	}
+
+	size_t size() const {
+		return num_ids;
+	}
+
+	bool empty() const {
+		return num_ids == 0;
+	}
+
+	size_t num_blocks() const {
+		return (num_ids <= INLINE_POSTINGS) ? (num_ids > 0) : (num_ids + POSTING_BLOCK_SIZE - 1) / POSTING_BLOCK_SIZE;
+	}
+
+	size_t memory_bytes() const {
+		return sizeof(*this) + num_data_words * sizeof(uint32_t);
+	}
+
+	appid block_first(size_t b) const {
+		return (num_ids <= INLINE_POSTINGS) ? inline_ids[0] : data[BLOCK_HEADER_WORDS * b];
+	}
+
+	appid block_last(size_t b) const {
+		return (num_ids <= INLINE_POSTINGS) ? inline_ids[num_ids - 1] : data[BLOCK_HEADER_WORDS * b + 1];
+	}
+
+	// Decodes block b into out (room for POSTING_BLOCK_SIZE ids) and returns how many ids it holds
+	size_t decode_block(size_t b, appid* out) const {
+		if (num_ids <= INLINE_POSTINGS) {
+			std::copy(inline_ids, inline_ids + num_ids, out);
+			return num_ids;
+		}
+
+		const uint32_t* header = data.get() + BLOCK_HEADER_WORDS * b;
+		const uint32_t* in = data.get() + header[2];
+		appid first = header[0];
+		uint32_t bits = header[3] & 0xFF;
+		size_t count = header[3] >> 8;
+		if (count == POSTING_BLOCK_SIZE) {
+#ifdef GAMESEARCH_X86
+			unpack_vertical_sse2(in, bits, out);
+			prefix_sum_sse2(out, first);
+			return POSTING_BLOCK_SIZE;
+#else
+			unpack_vertical_scalar(in, bits, out);
+#endif
+		}
+		else {
+			unpack_horizontal(in, count, bits, out);
+		}
+
+		appid running = first;
+		for (size_t i = 0; i < count; ++i) {
+			running += out[i];
+			out[i] = running;
+		}
+		return count;
+	}
+
+	template <typename Fn>
+	void for_each(Fn fn) const {
+		appid buffer[POSTING_BLOCK_SIZE];
+		for (size_t b = 0; b < num_blocks(); ++b) {
+			size_t count = decode_block(b, buffer);
+			for (size_t i = 0; i < count; ++i) {
+				fn(buffer[i]);
+			}
+		}
+	}
+
+	vector<appid> decode() const {
+		vector<appid> result(num_ids);
+		for (size_t b = 0; b < num_blocks(); ++b) {
+			decode_block(b, result.data() + b * POSTING_BLOCK_SIZE);
+		}
+		return result;
+	}
+
+	// Keeps the ids of sorted candidates that are in this list, blocks that can't match are skipped undecoded
+	vector<appid> intersect(const vector<appid>& candidates) const {
+		vector<appid> result;
+		appid buffer[POSTING_BLOCK_SIZE];
+		size_t blocks = num_blocks();
+		size_t b = 0;
+		size_t decoded = SIZE_MAX;
+		size_t count = 0;
+		size_t pos = 0;
+
+		for (const appid& id : candidates) {
+			while (b < blocks && block_last(b) < id) {
+				++b;
+			}
+			if (b == blocks) {
+				break;
+			}
+			if (id < block_first(b)) {
+				continue;
+			}
+			if (decoded != b) {
+				count = decode_block(b, buffer);
+				decoded = b;
+				pos = 0;
+			}
+			while (pos < count && buffer[pos] < id) {
+				++pos;
+			}
+			if (pos < count && buffer[pos] == id) {
+				result.push_back(id);
+			}
+		}
+		return result;
+	}
+
+	// Keeps the ids of sorted candidates that are NOT in this list, candidates outside every block are kept undecoded
+	vector<appid> difference(const vector<appid>& candidates) const {
+		vector<appid> result;
+		appid buffer[POSTING_BLOCK_SIZE];
+		size_t blocks = num_blocks();
+		size_t b = 0;
+		size_t decoded = SIZE_MAX;
+		size_t count = 0;
+		size_t pos = 0;
+
+		for (const appid& id : candidates) {
+			while (b < blocks && block_last(b) < id) {
+				++b;
+			}
+			if (b == blocks || id < block_first(b)) {
+				result.push_back(id);
+				continue;
+			}
+			if (decoded != b) {
+				count = decode_block(b, buffer);
+				decoded = b;
+				pos = 0;
+			}
+			while (pos < count && buffer[pos] < id) {
+				++pos;
+			}
+			if (pos == count || buffer[pos] != id) {
+				result.push_back(id);
+			}
+		}
+		return result;
+	}
+
+	// AND of every list, driven by the shortest one
+	static vector<appid> intersect(vector<const CompressedPostingList*> lists) {
+		if (lists.empty()) {
+			return vector<appid>();
+		}
+		std::sort(lists.begin(), lists.end(), [](const CompressedPostingList* a, const CompressedPostingList* b) {
+			return a->size() < b->size();
+		});
+
+		vector<appid> result = lists[0]->decode();
+		for (size_t i = 1; i < lists.size() && !result.empty(); ++i) {
+			result = lists[i]->intersect(result);
+		}
+		return result;
+	}
+
+private:
+
+	static uint32_t bit_width(uint32_t value) {
+		uint32_t bits = 0;
+		while (value != 0) {
+			++bits;
+			value >>= 1;
+		}
+		return bits;
+	}
+
+	static uint32_t low_mask(uint32_t bits) {
+		return (bits == 32) ? 0xFFFFFFFFu : (1u << bits) - 1;
+	}
+
+	// Lane j holds deltas j, j+4, j+8...; lane j's w-th word lives at words[offset + 4w + j]
+	static void pack_vertical(vector<uint32_t>& words, const uint32_t* deltas, uint32_t bits) {
+		size_t offset = words.size();
+		words.resize(offset + 4 * bits, 0);
+		for (size_t lane = 0; lane < 4; ++lane) {
+			size_t bit_pos = 0;
+			for (size_t k = 0; k < POSTING_BLOCK_SIZE / 4; ++k, bit_pos += bits) {
+				if (bits == 0) {
+					continue;
+				}
+				uint32_t value = deltas[4 * k + lane];
+				size_t w = bit_pos / 32;
+				size_t shift = bit_pos % 32;
+				words[offset + 4 * w + lane] |= value << shift;
+				if (shift + bits > 32) {
+					words[offset + 4 * (w + 1) + lane] |= value >> (32 - shift);
+				}
+			}
+		}
+	}
+
+	static void pack_horizontal(vector<uint32_t>& words, const uint32_t* deltas, size_t count, uint32_t bits) {
+		size_t offset = words.size();
+		words.resize(offset + (count * bits + 31) / 32, 0);
+		size_t bit_pos = 0;
+		for (size_t i = 0; i < count && bits > 0; ++i, bit_pos += bits) {
+			size_t w = bit_pos / 32;
+			size_t shift = bit_pos % 32;
+			words[offset + w] |= deltas[i] << shift;
+			if (shift + bits > 32) {
+				words[offset + w + 1] |= deltas[i] >> (32 - shift);
+			}
+		}
+	}
+
+	static void unpack_horizontal(const uint32_t* in, size_t count, uint32_t bits, uint32_t* out) {
+		uint32_t mask = low_mask(bits);
+		size_t bit_pos = 0;
+		for (size_t i = 0; i < count; ++i, bit_pos += bits) {
+			if (bits == 0) {
+				out[i] = 0;
+				continue;
+			}
+			size_t w = bit_pos / 32;
+			size_t shift = bit_pos % 32;
+			uint32_t value = in[w] >> shift;
+			if (shift + bits > 32) {
+				value |= in[w + 1] << (32 - shift);
+			}
+			out[i] = value & mask;
+		}
+	}
+
+	static void unpack_vertical_scalar(const uint32_t* in, uint32_t bits, uint32_t* out) {
+		uint32_t mask = low_mask(bits);
+		for (size_t lane = 0; lane < 4; ++lane) {
+			size_t bit_pos = 0;
+			for (size_t k = 0; k < POSTING_BLOCK_SIZE / 4; ++k, bit_pos += bits) {
+				if (bits == 0) {
+					out[4 * k + lane] = 0;
+					continue;
+				}
+				size_t w = bit_pos / 32;
+				size_t shift = bit_pos % 32;
+				uint32_t value = in[4 * w + lane] >> shift;
+				if (shift + bits > 32) {
+					value |= in[4 * (w + 1) + lane] << (32 - shift);
+				}
+				out[4 * k + lane] = value & mask;
+			}
+		}
+	}
+
+#ifdef GAMESEARCH_X86
+	static void unpack_vertical_sse2(const uint32_t* in, uint32_t bits, uint32_t* out) {
+		const __m128i mask = _mm_set1_epi32(static_cast<int>(low_mask(bits)));
+		const __m128i* lanes = reinterpret_cast<const __m128i*>(in);
+		size_t bit_pos = 0;
+		for (size_t k = 0; k < POSTING_BLOCK_SIZE / 4; ++k, bit_pos += bits) {
+			__m128i value = _mm_setzero_si128();
+			if (bits != 0) {
+				size_t w = bit_pos / 32;
+				int shift = static_cast<int>(bit_pos % 32);
+				value = _mm_srl_epi32(_mm_loadu_si128(lanes + w), _mm_cvtsi32_si128(shift));
+				if (shift + bits > 32) {
+					value = _mm_or_si128(value, _mm_sll_epi32(_mm_loadu_si128(lanes + w + 1), _mm_cvtsi32_si128(32 - shift)));
+				}
+				value = _mm_and_si128(value, mask);
+			}
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(out + 4 * k), value);
+		}
+	}
+
+	// In-register prefix sum of 4 lanes at a time, carrying the last lane into the next group
+	static void prefix_sum_sse2(uint32_t* values, appid first) {
+		__m128i carry = _mm_set1_epi32(static_cast<int>(first));
+		for (size_t k = 0; k < POSTING_BLOCK_SIZE; k += 4) {
+			__m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(values + k));
+			v = _mm_add_epi32(v, _mm_slli_si128(v, 4));
+			v = _mm_add_epi32(v, _mm_slli_si128(v, 8));
+			v = _mm_add_epi32(v, carry);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(values + k), v);
+			carry = _mm_shuffle_epi32(v, _MM_SHUFFLE(3, 3, 3, 3));
+		}
+	}
+#endif
+};
+
+/*
+* Keyword -> compressed posting list
+*	add() buffers raw ids while the library loads, finalize() sorts and compresses them and frees the buffers.
+*	Keys keep the order they were first seen in, which is what the *_list getters used to return.
+*
+*	With a normalizer every key goes through it before lookup, so differently spelled values of one entity share
+*	a canonical id and a single posting list. get_keys() returns the first spelling seen (trimmed) for each id.
+*	Keys that normalize to "" are not indexed.
+*
+*	Keys resolve through a FlatHashMap with one hash and one probe. Normalized lookups reuse a per-thread buffer,
+*	so find() doesn't allocate once the buffer has grown to the longest key.
+*/
+class PostingIndex {
+public:
+	typedef void(*Normalizer)(string_view, string&); // writes the canonical form of a key into the string
+	static constexpr uint32_t NO_KEY = UINT32_MAX;
+
+private:
+	Normalizer normalize;
+	FlatHashMap<uint32_t> key_ids;				// normalized key -> canonical id
+	vector<string> keys;						// canonical id -> display spelling
+	vector<CompressedPostingList> lists;
+	vector<vector<appid>> pending;
+
+public:
+
+	explicit PostingIndex(Normalizer normalize = nullptr) : normalize(normalize) {}
+
+	// Returns the canonical id of key, NO_KEY if it normalizes to ""
+	uint32_t add(string_view key, appid id) {
+		string_view lookup = canonical(key);
+		if (normalize && lookup.empty()) {
+			return NO_KEY;
+		}
+		pair<uint32_t*, bool> slot = key_ids.try_emplace(lookup, static_cast<uint32_t>(keys.size()));
+		if (slot.second) {
+			keys.emplace_back(normalize ? trim(key) : key);
+		}
+		if (pending.size() < keys.size()) {
+			pending.resize(keys.size());
+		}
+		pending[*slot.first].push_back(id);
+		return *slot.first;
+	}
+
+	void finalize() {
+		lists.resize(keys.size());
+		for (size_t k = 0; k < pending.size(); ++k) {
+			if (pending[k].empty()) {
+				continue;
+			}
+			vector<appid>& ids = pending[k];
+			if (!lists[k].empty()) {
+				vector<appid> existing = lists[k].decode();
+				ids.insert(ids.end(), existing.begin(), existing.end());
+			}
+			std::sort(ids.begin(), ids.end());
+			ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+			lists[k] = CompressedPostingList(ids);
+		}
+		pending.clear();
+		pending.shrink_to_fit();
+	}
+
+	// Canonical id of key, NO_KEY if it was never added
+	uint32_t id_of(string_view key) const {
+		const uint32_t* id = key_ids.find(canonical(key));
+		return (id == nullptr) ? NO_KEY : *id;
+	}
+
+	// nullptr if the key was never added, or update() took its last id away
+	const CompressedPostingList* find(string_view key) const {
+		uint32_t id = id_of(key);
+		return (id == NO_KEY || id >= lists.size() || lists[id].empty()) ? nullptr : &lists[id];
+	}
+
+	/*
+	* Patches a finalized index: removed (sorted) ids leave every list they're in, added (key, id) pairs join theirs
+	*	Every list is probed for the removed ids inside its first..last range (block headers only, blocks that
+	*	can't match stay undecoded), and only the lists that lose or gain an id are decoded and re-encoded. Returns how many lists that was. A key whose
+	*	list empties keeps its id and spelling, find() treats it as missing.
+	*/
+	size_t update(const vector<appid>& removed, const vector<pair<string, appid>>& added) {
+		for (const pair<string, appid>& entry : added) {
+			add(entry.first, entry.second);
+		}
+		lists.resize(keys.size());
+		pending.resize(keys.size());
+
+		size_t rewritten = 0;
+		vector<appid> gone;
+		for (size_t k = 0; k < lists.size(); ++k) {
+			gone.clear();
+			if (!lists[k].empty()) { // only the removed ids between the first and last id of the list can be in it
+				auto first = std::lower_bound(removed.begin(), removed.end(), lists[k].block_first(0));
+				auto last = std::upper_bound(first, removed.end(), lists[k].block_last(lists[k].num_blocks() - 1));
+				if (first != last) {
+					gone = lists[k].intersect(vector<appid>(first, last));
+				}
+			}
+			vector<appid>& gained = pending[k];
+			if (gone.empty() && gained.empty()) {
+				continue;
+			}
+
+			vector<appid> kept;
+			vector<appid> existing = lists[k].decode();
+			std::set_difference(existing.begin(), existing.end(), gone.begin(), gone.end(), std::back_inserter(kept));
+			std::sort(gained.begin(), gained.end());
+			vector<appid> ids;
+			std::set_union(kept.begin(), kept.end(), gained.begin(), gained.end(), std::back_inserter(ids));
+			ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+			lists[k] = CompressedPostingList(ids);
+			++rewritten;
+		}
+		pending.clear();
+		pending.shrink_to_fit();
+		return rewritten;
+	}
+
+	const CompressedPostingList& postings(uint32_t id) const {
+		return lists[id];
+	}
+
+	const vector<string>& get_keys() const {
+		return keys;
+	}
+
+	size_t size() const {
+		return keys.size();
+	}
+
+	bool empty() const {
+		return keys.empty();
+	}
+
+	void compact() {
+		key_ids.shrink_to_fit();
+		keys.shrink_to_fit();
+		lists.shrink_to_fit();
+	}
+
+	void memory_report(MemoryReport& report, const string& name) const {
+		report.add(name + "/keys", memory_usage::of(keys));
+		report.add(name + "/key lookup", key_ids.memory_bytes());
+		report.add(name + "/postings", posting_bytes() + (lists.capacity() - lists.size()) * sizeof(CompressedPostingList));
+	}
+
+	size_t posting_bytes() const {
+		size_t bytes = 0;
+		for (const CompressedPostingList& list : lists) {
+			bytes += list.memory_bytes();
+		}
+		return bytes;
+	}
+
+private:
+
+	// key as stored in key_ids, valid until the next call on this thread
+	string_view canonical(string_view key) const {
+		if (!normalize) {
+			return key;
+		}
+		static thread_local string buffer;
+		normalize(key, buffer);
+		return buffer;
+	}
+
+	static string_view trim(string_view key) {
+		size_t begin = key.find_first_not_of(" \t\r\n");
+		if (begin == string_view::npos) {
+			return string_view();
+		}
+		return key.substr(begin, key.find_last_not_of(" \t\r\n") - begin + 1);
+	}
+};
+
+/*
+* Row -> canonical key ids of one PostingIndex, its posting lists turned around
+*	Answers "which values does this row have" without touching a posting list, so per-row work (facet counts
+*	over a result, cube updates for changed rows) costs the rows' keys rather than every list of the index.
+*	Row r owns key_ids[offsets[r], offsets[r + 1]), ascending.
+*/
+class ForwardIndex {
+	vector<uint32_t> offsets{ 0 };
+	vector<uint32_t> key_ids;
+
+public:
+
+	ForwardIndex() {}
+
+	// row_of(id) maps an appid to its row, num_rows or more if it isn't one
+	template <typename RowOf>
+	ForwardIndex(const PostingIndex& index, size_t num_rows, RowOf&& row_of) {
+		vector<uint32_t> counts(num_rows + 1, 0);
+		for (uint32_t key = 0; key < index.size(); ++key) {
+			index.postings(key).for_each([&](appid id) {
+				size_t row = row_of(id);
+				if (row < num_rows) {
+					++counts[row + 1];
+				}
+			});
+		}
+		for (size_t r = 0; r < num_rows; ++r) {
+			counts[r + 1] += counts[r];
+		}
+		offsets = counts;
+		key_ids.resize(offsets.back());
+		for (uint32_t key = 0; key < index.size(); ++key) { // keys go in ascending, so every row comes out sorted
+			index.postings(key).for_each([&](appid id) {
+				size_t row = row_of(id);
+				if (row < num_rows) {
+					key_ids[counts[row]++] = key;
+				}
+			});
+		}
+	}
+
+	size_t size() const {
+		return offsets.size() - 1;
+	}
+
+	const uint32_t* begin(uint32_t row) const {
+		return key_ids.data() + offsets[row];
+	}
+
+	const uint32_t* end(uint32_t row) const {
+		return key_ids.data() + offsets[row + 1];
+	}
+
+	// Appends a row with the given keys (sorted, no repeats)
+	void append_row(const vector<uint32_t>& keys) {
+		key_ids.insert(key_ids.end(), keys.begin(), keys.end());
+		offsets.push_back(static_cast<uint32_t>(key_ids.size()));
+	}
+
+	// Appends a copy of row of other
+	void append_row(const ForwardIndex& other, uint32_t row) {
+		key_ids.insert(key_ids.end(), other.begin(row), other.end(row));
+		offsets.push_back(static_cast<uint32_t>(key_ids.size()));
+	}
+
+	void reserve(size_t num_rows, size_t num_keys) {
+		offsets.reserve(num_rows + 1);
+		key_ids.reserve(num_keys);
+	}
+
+	size_t memory_bytes() const {
+		return memory_usage::of(offsets) + memory_usage::of(key_ids);
+	}
+};
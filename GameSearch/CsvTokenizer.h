@@ -0,0 +1,245 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <istream>
+#include "Simd.h"
+#include <string>
+#include <string_view>
+#include <vector>
+
+using std::istream;
+using std::string;
+using std::string_view;
+using std::vector;
+
+// One field of a record. raw points into the tokenizer's buffer and excludes the surrounding quotes.
+struct CsvField {
+	string_view raw;
+	bool escaped = false; // raw contains "" pairs
+
+	string value() const {
+		if (!escaped) {
+			return string(raw);
+		}
+		string result;
+		result.reserve(raw.size());
+		for (size_t i = 0; i < raw.size(); ++i) {
+			result += raw[i];
+			if (raw[i] == '"' && i + 1 < raw.size() && raw[i + 1] == '"') {
+				++i;
+			}
+		}
+		return result;
+	}
+};
+
+/*
+* RFC 4180 tokenizer
+*	Structural characters are found 64 bytes at a time: quote, delimiter and newline bytes become 64-bit masks
+*	(SSE2 compares + movemask), a prefix XOR of the quote mask marks the bytes inside quotes, and what's left of
+*	delimiter | newline outside quotes are the field boundaries. An escaped "" toggles the quote state twice, so
+*	it needs no special case. Fields come back as views into the input, CRLF line endings are accepted.
+*/
+class CsvTokenizer {
+	string_view data;
+	char delimiter;
+	size_t pos = 0;				// start of the next field
+
+	size_t block_start = 0;		// data offset of the current 64 byte block
+	uint64_t structural = 0;	// unconsumed field boundaries of the current block
+	uint64_t quote_carry = 0;	// all ones if the previous block ended inside quotes
+	bool scanned = false;
+
+public:
+
+	explicit CsvTokenizer(string_view data, char delimiter = ',') : data(data), delimiter(delimiter) {}
+
+	bool done() const {
+		return pos >= data.size();
+	}
+
+	// Offset of the next unread byte
+	size_t position() const {
+		return pos;
+	}
+
+	/*
+	* Reads the next record into fields. Returns false once the input is used up.
+	* complete is set to false if the record ran into the end of the input without a newline, which a
+	* streaming reader uses to tell "last line of the file" from "record cut off by the buffer".
+	*/
+	bool next_record(vector<CsvField>& fields, bool* complete = nullptr) {
+		fields.clear();
+		if (done()) {
+			return false;
+		}
+
+		while (true) {
+			size_t end = next_structural();
+			bool end_of_record = (end >= data.size()) || data[end] == '\n';
+			size_t field_end = std::min(end, data.size());
+			if (end_of_record && field_end > pos && data[field_end - 1] == '\r') {
+				--field_end;
+			}
+			fields.push_back(make_field(pos, field_end));
+
+			if (complete != nullptr) {
+				*complete = end < data.size();
+			}
+			pos = std::min(end + 1, data.size());
+			if (end_of_record) {
+				return true;
+			}
+		}
+	}
+
+	// Splits a single line, used for short fields like "Valve;Hidden Path"
+	static vector<string> split(string_view line, char delimiter = ',') {
+		CsvTokenizer tokenizer(line, delimiter);
+		vector<CsvField> fields;
+		vector<string> result;
+		if (tokenizer.next_record(fields)) {
+			for (const CsvField& field : fields) {
+				result.push_back(field.value());
+			}
+		}
+		return result;
+	}
+
+private:
+
+	CsvField make_field(size_t begin, size_t end) const {
+		CsvField field;
+		if (end - begin >= 2 && data[begin] == '"' && data[end - 1] == '"') {
+			field.raw = data.substr(begin + 1, end - begin - 2);
+			field.escaped = field.raw.find('"') != string_view::npos;
+		}
+		else {
+			field.raw = data.substr(begin, end - begin);
+		}
+		return field;
+	}
+
+	// Next field boundary at or after pos, or data.size() if there isn't one
+	size_t next_structural() {
+		if (!scanned) {
+			scan_block(0);
+			scanned = true;
+		}
+		while (true) {
+			// drop boundaries that were already consumed
+			if (pos > block_start) {
+				size_t consumed = pos - block_start;
+				structural &= (consumed >= 64) ? 0 : ~((uint64_t(1) << consumed) - 1);
+			}
+			if (structural != 0) {
+				return block_start + simd::lowest_bit64(structural);
+			}
+			if (block_start + 64 >= data.size()) {
+				return data.size();
+			}
+			scan_block(block_start + 64);
+		}
+	}
+
+	void scan_block(size_t start) {
+		block_start = start;
+		char block[64];
+		const char* bytes = data.data() + start;
+		if (data.size() - start < 64) {
+			memset(block, 0, sizeof(block)); // zero padding never matches a structural character
+			memcpy(block, bytes, data.size() - start);
+			bytes = block;
+		}
+
+		uint64_t quotes, delimiters, newlines;
+		classify(bytes, quotes, delimiters, newlines);
+
+		uint64_t in_quotes = prefix_xor(quotes) ^ quote_carry;
+		quote_carry = (in_quotes >> 63) ? ~uint64_t(0) : 0;
+		structural = (delimiters | newlines) & ~in_quotes;
+	}
+
+	void classify(const char* bytes, uint64_t& quotes, uint64_t& delimiters, uint64_t& newlines) const {
+#ifdef GAMESEARCH_X86
+		const __m128i quote = _mm_set1_epi8('"');
+		const __m128i delim = _mm_set1_epi8(delimiter);
+		const __m128i newline = _mm_set1_epi8('\n');
+		quotes = delimiters = newlines = 0;
+		for (int i = 0; i < 4; ++i) {
+			__m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(bytes + 16 * i));
+			quotes |= uint64_t(static_cast<uint16_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, quote)))) << (16 * i);
+			delimiters |= uint64_t(static_cast<uint16_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, delim)))) << (16 * i);
+			newlines |= uint64_t(static_cast<uint16_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(chunk, newline)))) << (16 * i);
+		}
+#else
+		quotes = delimiters = newlines = 0;
+		for (int i = 0; i < 64; ++i) {
+			quotes |= uint64_t(bytes[i] == '"') << i;
+			delimiters |= uint64_t(bytes[i] == delimiter) << i;
+			newlines |= uint64_t(bytes[i] == '\n') << i;
+		}
+#endif
+	}
+
+	// Bit i of the result is the XOR of bits 0..i, i.e. set for every byte after an odd number of quotes
+	static uint64_t prefix_xor(uint64_t bits) {
+		bits ^= bits << 1;
+		bits ^= bits << 2;
+		bits ^= bits << 4;
+		bits ^= bits << 8;
+		bits ^= bits << 16;
+		bits ^= bits << 32;
+		return bits;
+	}
+};
+
+/*
+* Streams records out of an istream through a CsvTokenizer, buf_size bytes at a time
+*	A record cut off by the end of the buffer is re-read once more data has been appended, so quoted fields
+*	with embedded newlines work across buffer boundaries.
+*/
+class CsvReader {
+	istream& in;
+	size_t buf_size;
+	string buffer;
+	size_t offset = 0;		// start of the next record in buffer
+	bool eof = false;
+
+public:
+
+	explicit CsvReader(istream& in, size_t buf_size = 1 << 20) : in(in), buf_size(buf_size) {}
+
+	bool next_record(vector<string>& fields) {
+		vector<CsvField> views;
+		while (true) {
+			CsvTokenizer tokenizer(string_view(buffer).substr(offset));
+			bool complete = false;
+			if (tokenizer.next_record(views, &complete) && (complete || eof)) {
+				fields.clear();
+				for (const CsvField& field : views) {
+					fields.push_back(field.value());
+				}
+				offset += tokenizer.position();
+				return true;
+			}
+			if (eof) {
+				return false;
+			}
+			refill();
+		}
+	}
+
+private:
+
+	void refill() {
+		buffer.erase(0, offset);
+		offset = 0;
+		size_t old_size = buffer.size();
+		buffer.resize(old_size + buf_size);
+		in.read(&buffer[old_size], buf_size);
+		buffer.resize(old_size + static_cast<size_t>(in.gcount()));
+		eof = in.gcount() == 0 || in.eof();
+	}
+};
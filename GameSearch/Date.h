@@ -1,5 +1,8 @@
 #pragma once
+#include <charconv>
+#include <cstdint>
 #include <string>
+#include <string_view>
 #include <exception>
 #include <iostream>
 
@@ -7,6 +10,7 @@ using std::cout;
 using std::endl;
 using std::exception;
 using std::string;
+using std::string_view;
 
 
 
@@ -21,17 +25,14 @@ public:
 };
 
 
-//define helper function
-string trim_entries(string line, char delimiter, size_t n);
-
 class Date {
 	unsigned int year;
 	unsigned int month;
 	unsigned int day;
 
 public:
-	Date() : year(0), month(0), day(0) {};
-	
+	constexpr Date() : year(0), month(0), day(0) {};
+
 	Date(unsigned int y, unsigned int m, unsigned int d)  {
 		if (!is_valid_date(y, m, d)) {
 			throw NoSuchDate("Date isn't valid");
@@ -44,134 +45,141 @@ public:
 	};
 
 	// String constructor: proper format is "yyyy-mm-dd"
-	Date(const string& date) {  
-		*this = std::move(to_date(date));
+	Date(string_view date) : Date(to_date(date)) {}
+
+	// Days since 1970-01-01, dates before that are negative
+	constexpr int to_days() const noexcept {
+		return days_from_civil(static_cast<int>(year), month, day);
+	}
+
+	static constexpr Date from_days(int days) noexcept {
+		// civil_from_days, see http://howardhinnant.github.io/date_algorithms.html
+		days += 719468;
+		const int era = (days >= 0 ? days : days - 146096) / 146097;
+		const unsigned int doe = static_cast<unsigned int>(days - era * 146097);		// [0, 146096]
+		const unsigned int yoe = (doe - doe / 1460 + doe / 36524 - doe / 146096) / 365;	// [0, 399]
+		const unsigned int doy = doe - (365 * yoe + yoe / 4 - yoe / 100);				// [0, 365]
+		const unsigned int mp = (5 * doy + 2) / 153;									// [0, 11], March based
+		const unsigned int d = doy - (153 * mp + 2) / 5 + 1;
+		const unsigned int m = mp < 10 ? mp + 3 : mp - 9;
+		return Date(static_cast<unsigned int>(static_cast<int>(yoe) + era * 400 + (m <= 2)), m, d, Unchecked());
 	}
-	
-	Date& operator++() {
-		if (end_of_year()) {
-			++year;
-			month = 1;
-			day = 1;
-		}
-		else if (end_of_month()) {
-			++month;
-			day = 1;
-		}
-		else {
-			++day;
-		}
 
+	Date& operator++() {
+		*this = from_days(to_days() + 1);
 		return *this;
 	}
 
 	// Decrement day (less common operation, only used for finding maximum bound
-	Date& operator--() { 
-		if (month == 1 && day == 1) {
-			--year;
-			month = 12;
-			day = 31;
-		}
-		else if (day == 1) {
-			--month;
-			day = get_end_of_month();
-		}
-		else {
-			--day;
-		}
+	Date& operator--() {
+		*this = from_days(to_days() - 1);
+		return *this;
+	}
 
+	Date& operator+=(int days) {
+		*this = from_days(to_days() + days);
 		return *this;
 	}
-	
+
+	// Number of days from rhs to this date
+	int operator-(const Date& rhs) const noexcept {
+		return to_days() - rhs.to_days();
+	}
+
 	bool operator<(const Date& rhs) const noexcept {
-		return (year < rhs.year) || (year == rhs.year && month < rhs.month) || (year == rhs.year && month == rhs.month && day < rhs.day);
+		return packed() < rhs.packed();
 	}
 
 	bool operator>(const Date& rhs) const noexcept {
-		return (year > rhs.year) || (year == rhs.year && month > rhs.month) || (year == rhs.year && month == rhs.month && day > rhs.day);
+		return packed() > rhs.packed();
 	}
 
 	bool operator==(const Date& rhs) const noexcept {
-		return (day == rhs.day) && (month == rhs.month) && (year == rhs.year);
+		return packed() == rhs.packed();
 	}
 
 	bool operator!=(const Date& rhs) const noexcept {
 		return !(*this == rhs);
 	}
-	string to_string() const {
-		return std::to_string(year) + "-" + std::to_string(month) + "-" + std::to_string(day);
+
+	unsigned int get_year() const {
+		return year;
 	}
 
-	
+	unsigned int get_month() const {
+		return month;
+	}
 
-private:
+	unsigned int get_day() const {
+		return day;
+	}
 
-	static Date to_date(string s_date) {
-		unsigned int y;
-		unsigned int m;
-		unsigned int d;
-	
-		y = stoi(s_date.substr(0, s_date.find('-')));
-		s_date = std::move(trim_entries(s_date, '-', 1));
-		m = stoi(s_date.substr(0, s_date.find('-')));
-		s_date = std::move(trim_entries(s_date, '-', 1));
-		d = stoi(s_date);
-		return Date(y, m, d);
-		
-	}
-
-	bool is_valid_date(unsigned int y, unsigned int m, unsigned int d) {
-		if (d > 31 || m > 12) { // catches obvious erroneous dates
-			return false;
-		}
-		else if ((m % 2 == 1 && m <= 7) || (m % 2 == 0 && m > 7)) {  // checks for proper months that end with 31 days
-			return !(d > 31);
-		}
-		else if (m == 2) { // checks for imporper leap years
-			return (is_leap_year(y)) ? !(d > 29) : !(d > 28);
-		}
-		else { // ensures all other days are within 30 days
-			return !(d > 30);
-		}
+	string to_string() const {
+		return std::to_string(year) + "-" + std::to_string(month) + "-" + std::to_string(day);
 	}
 
-	bool is_leap_year(unsigned int y) {
+	static constexpr bool is_leap_year(unsigned int y) {
 		return ((y % 4 == 0) && !(y % 100 == 0)) || (y % 400 == 0);
 	}
 
-	bool end_of_month() {
-		if ((month % 2 == 1 && month < 7) || (month % 2 == 0 && month > 7)) {
-			return day == 31;
-		}
-		else if (month == 2) {
-			return (is_leap_year(year)) ? day == 29 : day == 28;
-		}
-		else {
-			return day == 30;
-		}
+	static constexpr unsigned int days_in_month(unsigned int y, unsigned int m) {
+		constexpr unsigned char days[12] = { 31, 28, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31 };
+		return (m == 2 && is_leap_year(y)) ? 29 : days[m - 1];
 	}
 
-	int get_end_of_month() {
-		if ((month % 2 == 1 && month < 7) || (month % 2 == 0 && month > 7)) {
-			return 31;
-		}
-		else if (month == 2) {
-			return (is_leap_year(year)) ? 29 : 28;
+	static constexpr int days_from_civil(int y, unsigned int m, unsigned int d) {
+		y -= m <= 2;
+		const int era = (y >= 0 ? y : y - 399) / 400;
+		const unsigned int yoe = static_cast<unsigned int>(y - era * 400);			// [0, 399]
+		const unsigned int doy = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;	// [0, 365]
+		const unsigned int doe = yoe * 365 + yoe / 4 - yoe / 100 + doy;				// [0, 146096]
+		return era * 146097 + static_cast<int>(doe) - 719468;
+	}
+
+private:
+
+	struct Unchecked {};
+
+	constexpr Date(unsigned int y, unsigned int m, unsigned int d, Unchecked) : year(y), month(m), day(d) {}
+
+	// year, month and day in one integer that orders the same way as the date
+	constexpr uint64_t packed() const noexcept {
+		return (uint64_t(year) << 9) | (month << 5) | day;
+	}
+
+	static Date to_date(string_view s_date) {
+		// fast path: exactly "yyyy-mm-dd", which is every date in the steam dump
+		if (s_date.size() == 10 && s_date[4] == '-' && s_date[7] == '-') {
+			unsigned int digits[8];
+			const char* p = s_date.data();
+			const int positions[8] = { 0, 1, 2, 3, 5, 6, 8, 9 };
+			unsigned int bad = 0;
+			for (int i = 0; i < 8; ++i) {
+				digits[i] = static_cast<unsigned int>(p[positions[i]] - '0');
+				bad |= digits[i] > 9;
+			}
+			if (!bad) {
+				return Date(digits[0] * 1000 + digits[1] * 100 + digits[2] * 10 + digits[3],
+					digits[4] * 10 + digits[5], digits[6] * 10 + digits[7]);
+			}
 		}
-		else {
-			return 30;
+
+		// general path: "y-m-d" with any number of digits per part
+		unsigned int parts[3] = { 0, 0, 0 };
+		const char* first = s_date.data();
+		const char* last = s_date.data() + s_date.size();
+		for (int i = 0; i < 3; ++i) {
+			auto result = std::from_chars(first, last, parts[i]);
+			bool separator_ok = (i < 2) ? (result.ptr != last && *result.ptr == '-') : (result.ptr == last);
+			if (result.ec != std::errc() || !separator_ok) {
+				throw NoSuchDate("Date isn't in yyyy-mm-dd format");
+			}
+			first = result.ptr + (i < 2);
 		}
+		return Date(parts[0], parts[1], parts[2]);
 	}
 
-	bool end_of_year() {
-		return month == 12 && day == 31;
+	static bool is_valid_date(unsigned int y, unsigned int m, unsigned int d) {
+		return m >= 1 && m <= 12 && d >= 1 && d <= days_in_month(y, m);
 	}
 };
-// Helper function
-string trim_entries(string line, char delimiter, size_t n) {
-	if (n == 0) {
-		return line;
-	}
-
-	return trim_entries(line.substr(line.find(delimiter) + 1), delimiter, n - 1);
-}
@@ -0,0 +1,222 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include "MemoryReport.h"
+#include "Simd.h"
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+using std::pair;
+using std::string;
+using std::string_view;
+using std::vector;
+
+/*
+* Open addressing map from strings to Value, Swiss table style
+*	Slots come in groups of 16, each with one control byte: EMPTY, or the low 7 bits of its key's hash. A lookup
+*	hashes the key once and checks a whole group of control bytes per step (one SSE2 compare + movemask), only
+*	entries whose 7 bits match get their stored hash and then their key compared. Entries sit in one vector in
+*	insertion order next to their 32 bit hash, slots hold entry indexes, so a rehash never rehashes a string and
+*	iterating is a vector walk.
+*
+*	Lookups take a string_view, no temporary string is built. There's no erase, nothing removes keys here.
+*
+* Methods
+*	find() - the value of key, nullptr if it isn't there
+*	try_emplace() - inserts key -> value unless key is there, returns (value, inserted)
+*	reserve() / shrink_to_fit() - size the table for n keys / for the keys it has
+*	memory_bytes() - heap bytes of the control bytes, slots, entries and keys
+*/
+template <typename Value>
+class FlatHashMap {
+public:
+	struct Entry {
+		string key;
+		uint32_t hash;
+		Value value;
+	};
+
+private:
+	static constexpr size_t GROUP_SIZE = 16;
+	static constexpr int8_t EMPTY = -128; // the only control byte with the top bit set
+	static constexpr size_t NOT_FOUND = SIZE_MAX;
+
+	vector<int8_t> control;	// one byte per slot, size is 0 or a power of two >= GROUP_SIZE
+	vector<uint32_t> slots;	// entry index of every full slot
+	vector<Entry> entries;
+
+public:
+
+	size_t size() const {
+		return entries.size();
+	}
+
+	bool empty() const {
+		return entries.empty();
+	}
+
+	typename vector<Entry>::const_iterator begin() const {
+		return entries.begin();
+	}
+
+	typename vector<Entry>::const_iterator end() const {
+		return entries.end();
+	}
+
+	const Value* find(string_view key) const {
+		size_t slot = find_slot(key, hash_of(key));
+		return (slot == NOT_FOUND) ? nullptr : &entries[slots[slot]].value;
+	}
+
+	Value* find(string_view key) {
+		size_t slot = find_slot(key, hash_of(key));
+		return (slot == NOT_FOUND) ? nullptr : &entries[slots[slot]].value;
+	}
+
+	pair<Value*, bool> try_emplace(string_view key, Value value) {
+		uint32_t hash = hash_of(key);
+		size_t slot = find_slot(key, hash);
+		if (slot != NOT_FOUND) {
+			return { &entries[slots[slot]].value, false };
+		}
+		if (capacity_for(entries.size() + 1) > control.size()) {
+			rehash(std::max(control.size() * 2, capacity_for(entries.size() + 1)));
+		}
+		insert_slot(hash, static_cast<uint32_t>(entries.size()));
+		entries.push_back({ string(key), hash, std::move(value) });
+		return { &entries.back().value, true };
+	}
+
+	void reserve(size_t num_keys) {
+		entries.reserve(num_keys);
+		if (capacity_for(num_keys) > control.size()) {
+			rehash(capacity_for(num_keys));
+		}
+	}
+
+	void shrink_to_fit() {
+		entries.shrink_to_fit();
+		for (Entry& entry : entries) {
+			entry.key.shrink_to_fit();
+		}
+		if (capacity_for(entries.size()) < control.size()) {
+			rehash(capacity_for(entries.size()));
+		}
+	}
+
+	void clear() {
+		control = vector<int8_t>();
+		slots = vector<uint32_t>();
+		entries = vector<Entry>();
+	}
+
+	size_t memory_bytes() const {
+		size_t bytes = memory_usage::of(control) + memory_usage::of(slots) + memory_usage::of(entries);
+		for (const Entry& entry : entries) {
+			bytes += memory_usage::of(entry.key) + value_bytes(entry.value);
+		}
+		return bytes;
+	}
+
+private:
+
+	// Heap bytes a value owns beyond its entry
+	static size_t value_bytes(const string& value) {
+		return memory_usage::of(value);
+	}
+
+	template <typename T>
+	static size_t value_bytes(const T&) {
+		return 0;
+	}
+
+	// std::hash plus a murmur3 finalizer, so the 7 control bits and the 25 group bits are both well mixed
+	static uint32_t hash_of(string_view key) {
+		uint64_t h = std::hash<string_view>()(key);
+		h ^= h >> 33;
+		h *= 0xff51afd7ed558ccdULL;
+		h ^= h >> 33;
+		return static_cast<uint32_t>(h);
+	}
+
+	static int8_t control_byte(uint32_t hash) {
+		return static_cast<int8_t>(hash & 0x7F);
+	}
+
+	// Smallest table holding num_keys at a load factor of at most 7/8
+	static size_t capacity_for(size_t num_keys) {
+		if (num_keys == 0) {
+			return 0;
+		}
+		size_t capacity = GROUP_SIZE;
+		while (capacity * 7 < num_keys * 8) {
+			capacity *= 2;
+		}
+		return capacity;
+	}
+
+	// Bit i is set if control byte i of the group equals byte
+	static uint32_t match(const int8_t* group, int8_t byte) {
+#ifdef GAMESEARCH_X86
+		__m128i bytes = _mm_loadu_si128(reinterpret_cast<const __m128i*>(group));
+		return static_cast<uint32_t>(_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_set1_epi8(byte))));
+#else
+		uint32_t mask = 0;
+		for (size_t i = 0; i < GROUP_SIZE; ++i) {
+			mask |= static_cast<uint32_t>(group[i] == byte) << i;
+		}
+		return mask;
+#endif
+	}
+
+	// Groups are probed triangularly (g, g+1, g+3, g+6...), which visits every group of a power of two table
+	size_t find_slot(string_view key, uint32_t hash) const {
+		if (control.empty()) {
+			return NOT_FOUND;
+		}
+		size_t group_mask = control.size() / GROUP_SIZE - 1;
+		size_t group = (hash >> 7) & group_mask;
+		for (size_t step = 1; ; ++step) {
+			const int8_t* bytes = control.data() + group * GROUP_SIZE;
+			for (uint32_t mask = match(bytes, control_byte(hash)); mask != 0; mask &= mask - 1) {
+				size_t slot = group * GROUP_SIZE + simd::lowest_bit(mask);
+				const Entry& entry = entries[slots[slot]];
+				if (entry.hash == hash && entry.key == key) {
+					return slot;
+				}
+			}
+			if (match(bytes, EMPTY) != 0) { // keys are never erased, so an empty slot ends the probe
+				return NOT_FOUND;
+			}
+			group = (group + step) & group_mask;
+		}
+	}
+
+	void insert_slot(uint32_t hash, uint32_t entry) {
+		size_t group_mask = control.size() / GROUP_SIZE - 1;
+		size_t group = (hash >> 7) & group_mask;
+		for (size_t step = 1; ; ++step) {
+			uint32_t empty = match(control.data() + group * GROUP_SIZE, EMPTY);
+			if (empty != 0) {
+				size_t slot = group * GROUP_SIZE + simd::lowest_bit(empty);
+				control[slot] = control_byte(hash);
+				slots[slot] = entry;
+				return;
+			}
+			group = (group + step) & group_mask;
+		}
+	}
+
+	void rehash(size_t capacity) {
+		control.assign(capacity, EMPTY);
+		control.shrink_to_fit();
+		slots.assign(capacity, 0);
+		slots.shrink_to_fit();
+		for (size_t i = 0; i < entries.size(); ++i) {
+			insert_slot(entries[i].hash, static_cast<uint32_t>(i));
+		}
+	}
+};
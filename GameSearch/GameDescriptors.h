@@ -1,13 +1,20 @@
 #pragma once
 
+#include <algorithm>
+#include "CsvTokenizer.h"
+#include "Date.h"
+#include <functional>
 #include <string>
+#include <string_view>
 #include <utility>
 #include <vector>
 
 using std::move;
 using std::string;
+using std::string_view;
 using std::vector;
 
+typedef unsigned int appid;
 
 class Game {
 	unsigned int id;
@@ -17,8 +24,11 @@ class Game {
 public:
 
 
-	Game(string data) {
-		attributes = std::move(split_string(data));
+	Game(const string& data) : Game(split_string(data)) {}
+
+	// fields of one csv record, in the order of the csv header
+	explicit Game(vector<string> fields) {
+		attributes = std::move(fields);
 		id = stoi(attributes[0]); 
 		name = attributes[1];
 	}
@@ -27,11 +37,11 @@ public:
 		return id;
 	}
 
-	string get_name() const {
+	const string& get_name() const {
 		return name;
 	}
 
-	vector<string> get_attributes() const {
+	const vector<string>& get_attributes() const {
 		return attributes;
 	}
 	
@@ -39,48 +49,68 @@ public:
 		return attributes.size();
 	}
 
+	// Order sensitive mix of the fields' hashes, equal for rows whose csv fields are equal (within one build)
+	uint64_t content_hash() const {
+		uint64_t hash = attributes.size();
+		for (const string& field : attributes) {
+			hash = (hash ^ std::hash<string_view>()(field)) * 0x9E3779B97F4A7C15ULL;
+			hash ^= hash >> 29;
+		}
+		return hash;
+	}
+
 	//static helper methods
 
+	// Splits one csv record, quoted fields may contain the delimiter and "" escapes
 	static vector<string> split_string(const string& data, const char& delimeter = ',') {
-		bool in_quotes = false;
-		vector<string> result;
-		string tmp = "";
-		for (size_t i = 0; i <= data.length(); ++i) { // using <= to save the last tag
-			if (i != data.length() && data[i] != ',' && data[i] != '\"' && !in_quotes) {
-				tmp += data[i];    // add char if it's not a ',' delimiter or in  
-			}
-			else if (data[i] == '\"') {
-				in_quotes = !in_quotes;    // toggle special behavior for an element in quotes
-			}
-			else if (in_quotes) {
-				tmp += data[i];    // if an element is surrounded by quotes, add every element even if it's a ',' 
-			}
-			else {
-				result.push_back(tmp);    // if the element is a ',' or we reached the end of the line, add element
-				tmp = "";					// to attributes array and reset the string
+		return CsvTokenizer::split(data, delimeter);
+	}
+
+	// Splits a list inside a single field (tags, developers...), quotes are part of the values here
+	static vector<string> split_list(string_view field, char delimiter = ';') {
+		vector<string> out;
+		size_t begin = 0;
+		while (true) {
+			size_t end = field.find(delimiter, begin);
+			out.emplace_back(field.substr(begin, end - begin));
+			if (end == string_view::npos) {
+				return out;
 			}
+			begin = end + 1;
 		}
-		return result;
 	}
 
+	/*
+	* Canonical spelling of a developer, publisher or tag, used as the index key
+	*	Leading/trailing whitespace is dropped, inner runs of whitespace become one space and ASCII letters
+	*	are lowercased, so "Square Enix ", "SQUARE ENIX" and "Square  Enix" are the same entity.
+	*/
+	static string normalize_entity(string_view entity) {
+		string out;
+		normalize_entity(entity, out);
+		return out;
+	}
 
-	static vector<string> process_tags(const string& line) {
-		string trimed_line = trim_entries(line, ',', 5);
-		string tags = trimed_line.substr(0, trimed_line.find(','));
-		vector<string> out;
-		size_t num_tags = count(tags.begin(), tags.end(), ';') + 1;
-
-		string tmp = "";
-		for (size_t i = 0; i <= tags.length(); ++i) { // using <= to save the last tag
-			if ((i != tags.length()) && tags[i] != ';') {
-				tmp += tags[i];
+	// Same, into out (cleared first), so lookups can reuse one buffer instead of allocating a string per key
+	static void normalize_entity(string_view entity, string& out) {
+		out.clear();
+		out.reserve(entity.size());
+		bool pending_space = false;
+		for (char c : entity) {
+			if (c == ' ' || c == '\t' || c == '\r' || c == '\n') {
+				pending_space = !out.empty();
+				continue;
 			}
-			else {
-				out.push_back(tmp);
-				tmp.clear();
+			if (pending_space) {
+				out += ' ';
+				pending_space = false;
 			}
+			out += (c >= 'A' && c <= 'Z') ? static_cast<char>(c - 'A' + 'a') : c;
 		}
-		return out;
+	}
+
+	static vector<string> process_tags(const string& tags) {
+		return split_list(tags, ';');
 	}
 
 };
\ No newline at end of file
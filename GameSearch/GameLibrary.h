@@ -1,35 +1,61 @@
 #pragma once
 #include <algorithm>
+#include "AggregateCube.h"
+#include "BooleanQuery.h"
 #include <chrono>
+#include "CompressedPostings.h"
+#include "CsvTokenizer.h"
 #include <ctime>
 #include "Date.h"
 #include <fstream>
 #include "GameDescriptors.h"
 #include <iostream>
+#include "LazyIndexes.h"
 #include <map>
+#include <memory>
+#include "MemoryReport.h"
+#include "PredicatePipeline.h"
 #include <queue>
+#include "RangeIndex.h"
+#include "ScanEngine.h"
 #include <set>
+#include "SetAlgebra.h"
+#include "SimilarityIndex.h"
+#include <stdexcept>
 #include <string>
-#include <unordered_map>
+#include "ThreadPool.h"
 #include <vector>
 
 using std::cerr;
 using std::iostream;
 using std::ifstream;
 using std::map;
-using std::multimap;
 using std::pair;
 using std::priority_queue;
 using std::set;
 using std::string;
 using std::time;
-using std::unordered_map;
+using std::unique_ptr;
 using std::vector;
 
-typedef unsigned int appid;
 constexpr int LOAD_INTERVAL = 5000; // used for "progress bar" animation
+constexpr double INDEXED_SELECTIVITY = 0.25; // a range term estimated to match fewer rows than this drives the query
 const::string DATA_FILE = "steam_games_trimmed.csv";
 
+// Compact drops the raw Game rows once everything is indexed, see GameLibrary::compact()
+// Lazy builds each index on first use while a background thread warms the rest, see GameLibrary::build_indexes()
+enum class LibraryMode { Standard, Compact, Lazy };
+
+// What GameLibrary::reload() found and did
+struct ReloadStats {
+	size_t inserted = 0;
+	size_t updated = 0;
+	size_t deleted = 0;
+	size_t unchanged = 0;
+	size_t lists_rewritten = 0; // developer, publisher and genre posting lists re-encoded
+	double seconds = 0;			// diffing and patching, not reading the csv
+};
+
 struct SetContainer {
 	set<appid> _set;
 	size_t size;
@@ -42,49 +68,338 @@ struct SetContainer {
 };
 
 class GameLibrary {
+	// every index that's built from the rows, in no particular order (see WARM_UP_ORDER)
+	enum class LazyIndex : size_t { Names, Dates, Reviews, Columns, Developers, Publishers, Genres, Facets, Ranges, Cube, Similarity, Count };
+
 	vector<Game> games;
 	vector<string> descriptors; // if all searches were implemented, would be used to get title of every searchable element, however, some search items were ommited
 
 
-	unordered_map<appid, string> name_lookup;
+	// names back to back, row r of columns is [name_offsets[r], name_offsets[r + 1]), handed out as string_views
+	string name_arena;
+	vector<uint32_t> name_offsets;
 
 	pair<Date, Date> date_bounds; // Lower bound = .first upper bound = .second
-	multimap<Date, appid> release_dates;
+	vector<pair<Date, appid>> release_dates; // sorted by date so range scans can be split into morsels
+
+	// keyed by normalized name, so spelling variants of one studio/tag share a posting list
+	PostingIndex developers{ &Game::normalize_entity };
+	PostingIndex publishers{ &Game::normalize_entity };
+	PostingIndex genres{ &Game::normalize_entity };
+
+	vector<pair<int, appid>> positive_reviews; // sorted by number of reviews
+
+	GameColumns columns; // typed copies of the numeric attributes for full-scan filters
+
+	// column row -> canonical ids in developers/publishers/genres
+	ForwardIndex developer_keys;
+	ForwardIndex publisher_keys;
+	ForwardIndex genre_keys;
 
-	vector<string> developers_list;
-	unordered_map<string, vector<appid>> developers;
+	// equi-depth buckets over columns.price_cents and columns.owners_low, also the histograms the planner estimates with
+	RangeIndex price_index;
+	RangeIndex owners_index;
 
-	vector<string> publishers_list;
-	unordered_map<string, vector<appid>> publishers;
+	unique_ptr<SimilarityIndex> similarity; // not part of the eager build, first search_similar() builds it
 
-	vector<string> genre_types;
-	unordered_map<string, vector<appid>> genres;
+	AggregateCube cube{ genres, developers, publishers }; // per month aggregates
 
-	multimap<int, appid> positive_reviews;
+	LazyIndexes lazy{ static_cast<size_t>(LazyIndex::Count) }; // last, so the warm-up thread is joined before anything it builds is destroyed
 public:
 
-	GameLibrary() {
+	explicit GameLibrary(LibraryMode mode = LibraryMode::Standard) {
 		allocate_games();
-		allocate_all_attributes();
+		build_indexes(mode);
 	}
 
-	set<appid> search_by_date(const string& begin_date, const string& end_date) {
-		if (release_dates.size() == 0) {
-			allocate_dates();
+	// Library over a subset of the catalog, e.g. one shard of a ShardedLibrary
+	GameLibrary(vector<Game> rows, vector<string> header, LibraryMode mode = LibraryMode::Standard) {
+		games = std::move(rows);
+		descriptors = std::move(header);
+		build_indexes(mode);
+	}
+
+	// Reads every complete record of a csv file, header receives the first line
+	static vector<Game> read_games(const string& path, vector<string>& header) {
+		auto start = std::chrono::steady_clock::now();
+		ifstream steam_games(path, std::ios::binary);
+		CsvReader reader(steam_games);
+		vector<string> fields;
+		vector<Game> rows;
+
+		if (reader.next_record(fields)) {
+			header = std::move(fields);
+		}
+
+		int i = 0;
+		cout << "Reading csv file and allocating games";
+		while (reader.next_record(fields)) {
+			if (fields.size() < header.size()) { // blank or truncated line
+				continue;
+			}
+			rows.push_back(Game(std::move(fields)));
+			++i;
+			if (i % LOAD_INTERVAL == 0) { // "pretty animations"
+				cout << ".";
+			}
+		}
+
+		cout << "Finished allocating games" << endl;
+
+		auto end = std::chrono::steady_clock::now();
+		std::chrono::duration<double> elapsed_seconds = end - start;
+		cout << "  Took: " << elapsed_seconds.count() << "s to store data" << endl;
+		return rows;
+	}
+
+	/*
+	* Frees everything that's only needed to build the indexes
+	*	The Game rows go away (names move into one arena indexed by column row), every container and keyword hash
+	*	table is shrunk to its size. Searches return the same results afterwards.
+	*/
+	void compact() {
+		lazy.stop(); // the warm-up may still be reading the columns shrunk below
+		ensure_row_indexes();
+
+		games = vector<Game>();
+
+		release_dates.shrink_to_fit();
+		positive_reviews.shrink_to_fit();
+		columns.shrink_to_fit();
+		developers.compact();
+		publishers.compact();
+		genres.compact();
+	}
+
+	/*
+	* Brings the library up to date with a newer dump of the csv without rebuilding it
+	*	Rows are matched by appid and compared by Game::content_hash(), and only inserted and updated rows are
+	*	parsed. Index work follows the change: posting lists that gain or lose a game are re-encoded, the cube
+	*	takes the old games out and the new ones in cell by cell, range index buckets take the new rows in where
+	*	their values fall, and the sorted date and review indexes are patched in one merge each. What is linear in
+	*	the catalog is copying: columns, names, row -> key lists and range buckets are re-laid in the new row order
+	*	in one pass, nothing is re-sorted or re-parsed. The similarity index is rebuilt on its next use.
+	*
+	*	Like compact(), nothing may query the library while it reloads. Throws std::runtime_error, with the library
+	*	unchanged, if path has no csv header.
+	*/
+	ReloadStats reload(const string& path) {
+		lazy.stop();
+		ensure_row_indexes();
+
+		vector<string> header;
+		vector<Game> rows = read_games(path, header);
+		if (header.empty()) { // missing or empty file, not a catalog with every game deleted
+			throw std::runtime_error("couldn't read a csv header from " + path);
 		}
 		auto start = std::chrono::steady_clock::now();
+		if (!std::is_sorted(rows.begin(), rows.end(), [](const Game& a, const Game& b) { return a.get_id() < b.get_id(); })) {
+			std::stable_sort(rows.begin(), rows.end(), [](const Game& a, const Game& b) { return a.get_id() < b.get_id(); });
+		}
 
-		set<appid> result;
-		multimap<Date, appid>::iterator iter, begin_iter, end_iter;
+		vector<uint32_t> old_order(columns.size()); // old rows by appid
+		for (uint32_t row = 0; row < old_order.size(); ++row) {
+			old_order[row] = row;
+		}
+		if (!columns.ids_sorted) {
+			std::sort(old_order.begin(), old_order.end(), [&](uint32_t a, uint32_t b) { return columns.ids[a] < columns.ids[b]; });
+		}
 
-		
+		// one merge over both appid orders: layout is the new row order, changed the inserted and updated games
+		ReloadStats stats;
+		vector<pair<bool, uint32_t>> layout; // (changed, row in changed) or (unchanged, old row)
+		vector<Game> changed;
+		vector<appid> removed; // deleted and updated appids, sorted
+		vector<uint32_t> removed_rows; // their old rows
+		size_t i = 0;
+		size_t j = 0;
+		while (i < old_order.size() || j < rows.size()) {
+			appid old_id = (i < old_order.size()) ? columns.ids[old_order[i]] : UINT32_MAX;
+			appid new_id = (j < rows.size()) ? rows[j].get_id() : UINT32_MAX;
+			if (j < rows.size() && j > 0 && new_id == rows[j - 1].get_id()) {
+				++j; // a repeated appid keeps its first row
+				continue;
+			}
+			if (i < old_order.size() && (j == rows.size() || old_id < new_id)) {
+				removed.push_back(old_id);
+				removed_rows.push_back(old_order[i]);
+				++stats.deleted;
+				++i;
+			}
+			else if (i == old_order.size() || new_id < old_id) {
+				layout.emplace_back(true, static_cast<uint32_t>(changed.size()));
+				changed.push_back(std::move(rows[j]));
+				++stats.inserted;
+				++j;
+			}
+			else if (rows[j].content_hash() != columns.content_hashes[old_order[i]]) {
+				removed.push_back(old_id);
+				removed_rows.push_back(old_order[i]);
+				layout.emplace_back(true, static_cast<uint32_t>(changed.size()));
+				changed.push_back(std::move(rows[j]));
+				++stats.updated;
+				++i;
+				++j;
+			}
+			else {
+				layout.emplace_back(false, old_order[i]);
+				++stats.unchanged;
+				++i;
+				++j;
+			}
+		}
+		rows = vector<Game>();
+
+		// the old games leave the cube while their rows and keys are still there
+		for (const uint32_t& row : removed_rows) {
+			for_each_cube_entry(row, [&](Facet facet, const vector<uint32_t>& keys, const Date& release, uint32_t positive, uint32_t negative, uint32_t price) {
+				cube.remove(facet, keys, release, positive, negative, price);
+			}, [&](const Date& release, uint32_t positive, uint32_t negative, uint32_t price) {
+				cube.remove_total(release, positive, negative, price);
+			});
+		}
+
+		stats.lists_rewritten += developers.update(removed, keyword_entries(changed, 3));
+		stats.lists_rewritten += publishers.update(removed, keyword_entries(changed, 4));
+		stats.lists_rewritten += genres.update(removed, keyword_entries(changed, 5));
+
+		vector<pair<Date, appid>> added_dates;
+		vector<pair<int, appid>> added_reviews;
+		GameColumns changed_columns;
+		for (const Game& g : changed) {
+			added_dates.emplace_back(Date(g.get_attributes()[2]), g.get_id());
+			added_reviews.emplace_back(stoi(g.get_attributes()[6]), g.get_id());
+			changed_columns.append(g);
+		}
+		patch_sorted(release_dates, removed, std::move(added_dates));
+		patch_sorted(positive_reviews, removed, std::move(added_reviews));
+		if (!release_dates.empty()) {
+			date_bounds.first = release_dates.front().first;
+			date_bounds.second = release_dates.back().first;
+		}
+		else {
+			date_bounds = pair<Date, Date>(); // what loading an empty catalog leaves
+		}
 
-		begin_iter = std::move(find_minimum_valid_date(begin_date));
-		end_iter = std::move(find_maximum_valid_date(end_date));
+		GameColumns next_columns;
+		string next_arena;
+		vector<uint32_t> next_offsets;
+		vector<Game> next_games;
+		ForwardIndex next_keys[3]; // by Facet
+		next_columns.reserve(layout.size());
+		next_arena.reserve(name_arena.size());
+		next_offsets.reserve(layout.size() + 1);
+		next_offsets.push_back(0);
+		for (const Facet& facet : { Facet::Genre, Facet::Developer, Facet::Publisher }) {
+			const ForwardIndex& keys = row_keys(facet);
+			next_keys[static_cast<int>(facet)].reserve(layout.size(), keys.memory_bytes() / sizeof(uint32_t));
+		}
+		vector<uint32_t> new_row(columns.size(), UINT32_MAX); // old row -> new row, UINT32_MAX for removed rows
+		vector<uint32_t> added_rows;
+		bool keep_games = !games.empty(); // compact() dropped them otherwise
+		for (const pair<bool, uint32_t>& source : layout) {
+			uint32_t row = static_cast<uint32_t>(next_columns.size());
+			if (source.first) {
+				next_columns.append_row(changed_columns, source.second);
+				next_arena += changed[source.second].get_name();
+				const vector<string>& attributes = changed[source.second].get_attributes();
+				next_keys[static_cast<int>(Facet::Developer)].append_row(key_ids_of(developers, attributes[3]));
+				next_keys[static_cast<int>(Facet::Publisher)].append_row(key_ids_of(publishers, attributes[4]));
+				next_keys[static_cast<int>(Facet::Genre)].append_row(key_ids_of(genres, attributes[5]));
+				added_rows.push_back(row);
+			}
+			else {
+				next_columns.append_row(columns, source.second);
+				next_arena += name_of_row(source.second);
+				for (const Facet& facet : { Facet::Genre, Facet::Developer, Facet::Publisher }) {
+					next_keys[static_cast<int>(facet)].append_row(row_keys(facet), source.second);
+				}
+				new_row[source.second] = row;
+			}
+			next_offsets.push_back(static_cast<uint32_t>(next_arena.size()));
+			if (keep_games) {
+				next_games.push_back(std::move(source.first ? changed[source.second] : games[source.second]));
+			}
+		}
+		columns = std::move(next_columns);
+		name_arena = std::move(next_arena);
+		name_offsets = std::move(next_offsets);
+		games = std::move(next_games);
+		genre_keys = std::move(next_keys[static_cast<int>(Facet::Genre)]);
+		developer_keys = std::move(next_keys[static_cast<int>(Facet::Developer)]);
+		publisher_keys = std::move(next_keys[static_cast<int>(Facet::Publisher)]);
+
+		price_index.update(columns.price_cents, new_row, added_rows);
+		owners_index.update(columns.owners_low, new_row, added_rows);
+
+		// the new games join the cube, then cells that lost a min or max are recounted from their month
+		for (const uint32_t& row : added_rows) {
+			for_each_cube_entry(row, [&](Facet facet, const vector<uint32_t>& keys, const Date& release, uint32_t positive, uint32_t negative, uint32_t price) {
+				cube.add(facet, keys, release, positive, negative, price);
+			}, [&](const Date& release, uint32_t positive, uint32_t negative, uint32_t price) {
+				cube.add_total(release, positive, negative, price);
+			});
+		}
+		cube.finalize();
+		for (const AggregateCube::CellRef& cell : cube.take_stale()) {
+			cube.replace(cell, recount(cell));
+		}
 
-		for (iter = begin_iter; iter != end_iter; ++iter) {
-			result.insert((*iter).second);
+		lazy.reset(static_cast<size_t>(LazyIndex::Similarity));
+		similarity.reset();
+
+		auto end = std::chrono::steady_clock::now();
+		std::chrono::duration<double> elapsed_seconds = end - start;
+		stats.seconds = elapsed_seconds.count();
+		return stats;
+	}
+
+	// Estimated heap bytes of every index and column
+	MemoryReport memory_report() const {
+		ensure_row_indexes();
+
+		MemoryReport report;
+		size_t game_bytes = memory_usage::of(games);
+		for (const Game& g : games) {
+			game_bytes += memory_usage::of(g.get_attributes());
+			game_bytes += memory_usage::of(g.get_name());
 		}
+		report.add("games", game_bytes);
+		report.add("descriptors", memory_usage::of(descriptors));
+		report.add("names/arena", memory_usage::of(name_arena) + memory_usage::of(name_offsets));
+		report.add("release_dates", memory_usage::of(release_dates));
+		developers.memory_report(report, "developers");
+		publishers.memory_report(report, "publishers");
+		genres.memory_report(report, "genres");
+		report.add("positive_reviews", memory_usage::of(positive_reviews));
+		report.add("columns/ids", memory_usage::of(columns.ids));
+		report.add("columns/release_ymd", memory_usage::of(columns.release_ymd));
+		report.add("columns/release_month", memory_usage::of(columns.release_month));
+		report.add("columns/positive_ratings", memory_usage::of(columns.positive_ratings));
+		report.add("columns/negative_ratings", memory_usage::of(columns.negative_ratings));
+		report.add("columns/owners_low", memory_usage::of(columns.owners_low));
+		report.add("columns/owners_high", memory_usage::of(columns.owners_high));
+		report.add("columns/price_cents", memory_usage::of(columns.price_cents));
+		report.add("columns/content_hashes", memory_usage::of(columns.content_hashes));
+		report.add("facets/developers", developer_keys.memory_bytes());
+		report.add("facets/publishers", publisher_keys.memory_bytes());
+		report.add("facets/genres", genre_keys.memory_bytes());
+		report.add("ranges/price", price_index.memory_bytes());
+		report.add("ranges/owners", owners_index.memory_bytes());
+		report.add("similarity", is_ready(LazyIndex::Similarity) ? similarity->memory_bytes() : 0);
+		report.add("cube", cube.memory_bytes());
+		return report;
+	}
+
+	set<appid> search_by_date(const string& begin_date, const string& end_date) {
+		ensure(LazyIndex::Dates);
+		auto start = std::chrono::steady_clock::now();
+
+		size_t begin_row = find_minimum_valid_date(begin_date);
+		size_t end_row = find_maximum_valid_date(end_date);
+
+		set<appid> result = gather_ids(release_dates, begin_row, end_row);
+
 		auto end = std::chrono::steady_clock::now();
 		std::chrono::duration<double> elapsed_seconds = end - start;
 		cout << "Search by date took: " << elapsed_seconds.count() << "s" << endl;
@@ -92,21 +407,20 @@ public:
 	}
 
 	set<appid> search_by_developer(const string& keyword) {
-		if (developers.size() == 0) {
-			allocate_developers();
-		}
+		ensure(LazyIndex::Developers);
 
 		auto start = std::chrono::steady_clock::now();
 
 		set<appid> result;
-		if (developers.find(keyword) == developers.end()) {
+		const CompressedPostingList* postings = developers.find(keyword);
+		if (postings == nullptr) {
 			cout << "No developers called \"" << keyword << "\" found!" << endl;
 			return result;
 		} 
 
-		for (size_t i = 0; i < developers.at(keyword).size(); ++i) {
-			result.insert(developers.at(keyword)[i]);
-		}
+		postings->for_each([&](appid id) {
+			result.insert(result.end(), id); // postings are sorted
+		});
 		auto end = std::chrono::steady_clock::now();
 		std::chrono::duration<double> elapsed_seconds = end - start;
 		cout << "Search by developer took: " << elapsed_seconds.count() << "s" << endl;
@@ -114,20 +428,19 @@ public:
 	}
 
 	set<appid> search_by_publisher(const string& keyword) {
-		if (publishers.size() == 0) {
-			allocate_publishers();
-		}
+		ensure(LazyIndex::Publishers);
 		auto start = std::chrono::steady_clock::now();
 
 		set<appid> result;
-		if (publishers.find(keyword) == publishers.end()) {
+		const CompressedPostingList* postings = publishers.find(keyword);
+		if (postings == nullptr) {
 			cout << "No publishers called \"" << keyword << "\" found!" << endl;
 			return result;
 		}
 
-		for (size_t i = 0; i < publishers.at(keyword).size(); ++i) {
-			result.insert(publishers.at(keyword)[i]);
-		}
+		postings->for_each([&](appid id) {
+			result.insert(result.end(), id); // postings are sorted
+		});
 		auto end = std::chrono::steady_clock::now();
 		std::chrono::duration<double> elapsed_seconds = end - start;
 		cout << "Search by publisher took: " << elapsed_seconds.count() << "s" << endl;
@@ -135,19 +448,44 @@ public:
 	}
 
 	set<appid> search_by_genre(const string& keyword) {
-		if (genres.size() == 0) {
-			allocate_genres();
-		}
+		ensure(LazyIndex::Genres);
 		auto start = std::chrono::steady_clock::now();
 
 		set<appid> result;
-		if (genres.find(keyword) == genres.end()) {
+		const CompressedPostingList* postings = genres.find(keyword);
+		if (postings == nullptr) {
 			cout << "No genres called \"" << keyword << "\" found!" << endl;
 			return result;
 		}
 		
-		for (size_t i = 0; i < genres.at(keyword).size(); ++i) {
-			result.insert(genres.at(keyword)[i]);
+		postings->for_each([&](appid id) {
+			result.insert(result.end(), id); // postings are sorted
+		});
+		auto end = std::chrono::steady_clock::now();
+		std::chrono::duration<double> elapsed_seconds = end - start;
+		cout << "Search by tags took: " << elapsed_seconds.count() << "s" << endl;
+
+		return result;
+	}
+
+	// Games tagged with every genre in keywords, intersected on the compressed posting lists
+	set<appid> search_by_genres(const vector<string>& keywords) {
+		ensure(LazyIndex::Genres);
+		auto start = std::chrono::steady_clock::now();
+
+		set<appid> result;
+		vector<const CompressedPostingList*> lists;
+		for (const string& keyword : keywords) {
+			const CompressedPostingList* postings = genres.find(keyword);
+			if (postings == nullptr) {
+				cout << "No genres called \"" << keyword << "\" found!" << endl;
+				return result;
+			}
+			lists.push_back(postings);
+		}
+
+		for (const appid& id : CompressedPostingList::intersect(lists)) {
+			result.insert(result.end(), id);
 		}
 		auto end = std::chrono::steady_clock::now();
 		std::chrono::duration<double> elapsed_seconds = end - start;
@@ -157,6 +495,7 @@ public:
 	}
 
 	set<appid> search_by_positive_reviews(const string& num_positive_reviews) {
+		ensure(LazyIndex::Reviews);
 		auto start = std::chrono::steady_clock::now();
 
 		set<appid> result;
@@ -170,17 +509,11 @@ public:
 			return result;
 		}
 
-		// find nearest number of review, should be pretty quick
-		while (positive_reviews.find(num_reviews) == positive_reviews.end()) {
-			++num_reviews;
-		}
+		// first game with at least num_reviews positive reviews
+		size_t begin_row = std::lower_bound(positive_reviews.begin(), positive_reviews.end(), pair<int, appid>(num_reviews, 0)) - positive_reviews.begin();
 
-		multimap<int, appid>::iterator lower_bound = positive_reviews.find(num_reviews);
+		result = gather_ids(positive_reviews, begin_row, positive_reviews.size());
 
-		while (lower_bound != positive_reviews.end()) {
-			result.insert(lower_bound->second);
-			++lower_bound;
-		}
 		auto end = std::chrono::steady_clock::now();
 		std::chrono::duration<double> elapsed_seconds = end - start;
 		cout << "Search by reviews took: " << elapsed_seconds.count() << "s" << endl;
@@ -188,6 +521,199 @@ public:
 		return result ;
 	}
 
+	// AND/OR/NOT over the keyword indexes, e.g. "genre:Strategy AND NOT genre:Early Access", see BooleanQuery
+	set<appid> search_by_query(const string& expression) {
+		auto start = std::chrono::steady_clock::now();
+
+		set<appid> result;
+		vector<appid> universe;
+		vector<appid> ids;
+		try {
+			ids = BooleanQuery(expression).evaluate(
+				[&](Facet facet, const string& value) {
+					const CompressedPostingList* postings = get_index(facet).find(value);
+					if (postings == nullptr) {
+						const char* what = (facet == Facet::Genre) ? "genres" : (facet == Facet::Developer) ? "developers" : "publishers";
+						cout << "No " << what << " called \"" << value << "\" found!" << endl;
+					}
+					return postings;
+				},
+				[&]() -> const vector<appid>& {
+					if (universe.empty()) {
+						universe = sorted_ids();
+					}
+					return universe;
+				});
+		}
+		catch (std::invalid_argument& e) {
+			cout << "Incorrect Parameters: " << e.what() << endl;
+			return result;
+		}
+
+		for (const appid& id : ids) {
+			result.insert(result.end(), id);
+		}
+		auto end = std::chrono::steady_clock::now();
+		std::chrono::duration<double> elapsed_seconds = end - start;
+		cout << "Search by query took: " << elapsed_seconds.count() << "s" << endl;
+		return result;
+	}
+
+	// Filters without an index (price, ratio, owners, month...) scan the typed columns, all predicates are ANDed
+	set<appid> search_by_scan(const vector<ScanPredicate>& predicates) {
+		ensure(LazyIndex::Columns);
+		auto start = std::chrono::steady_clock::now();
+
+		set<appid> result;
+		for (const uint32_t& row : ScanEngine(columns).filter(predicates)) {
+			result.insert(result.end(), columns.ids[row]); // hint is free when the csv is sorted by appid, as the steam dump is
+		}
+
+		auto end = std::chrono::steady_clock::now();
+		std::chrono::duration<double> elapsed_seconds = end - start;
+		cout << "Search by scan took: " << elapsed_seconds.count() << "s" << endl;
+		return result;
+	}
+
+	// Runs a whole conjunctive query in one pass, fused into a single loop when its shape is registered
+	set<appid> search(const QuerySpec& query) {
+		ensure(LazyIndex::Columns);
+		auto start = std::chrono::steady_clock::now();
+
+		bool indexed = false;
+		set<appid> result;
+		for (const uint32_t& row : match_rows(query, indexed)) {
+			result.insert(result.end(), columns.ids[row]);
+		}
+
+		auto end = std::chrono::steady_clock::now();
+		std::chrono::duration<double> elapsed_seconds = end - start;
+		cout << "Search by " << (indexed ? "indexed " : "")
+			<< (PipelineRegistry::instance().is_specialized(query.shape()) ? "fused" : "interpreted")
+			<< " pipeline took: " << elapsed_seconds.count() << "s" << endl;
+		return result;
+	}
+
+	// Rows matching query in ascending order, what search() runs without the timing and set conversion
+	vector<uint32_t> match_rows(const QuerySpec& query) const {
+		bool indexed = false;
+		return match_rows(query, indexed);
+	}
+
+	/*
+	* Storefront filters ("price under $10, at least 1M owners") without a scan
+	*	The price and owners terms are estimated on their histograms. If the most selective one is expected to
+	*	keep less than INDEXED_SELECTIVITY of the rows, its RangeIndex hands over the candidate rows and the rest of
+	*	the query only runs on those. Otherwise the fused scan is cheaper and runs as before. indexed tells which.
+	*/
+	vector<uint32_t> match_rows(const QuerySpec& query, bool& indexed) const {
+		ensure(LazyIndex::Columns);
+		const PipelineRegistry& registry = PipelineRegistry::instance();
+		int32_t lo = 0;
+		int32_t hi = 0;
+		const RangeIndex* range = most_selective_range(query, lo, hi);
+		indexed = (range != nullptr);
+		if (range == nullptr) {
+			return registry.run(columns, query);
+		}
+		return registry.run(columns, query, range->select(lo, hi));
+	}
+
+	// Number of rows per value of facet in key order, values with no rows are left out. Reads only the given rows.
+	vector<pair<string, size_t>> facet_counts(Facet facet, const vector<uint32_t>& rows) const {
+		const PostingIndex& index = get_index(facet);
+		const ForwardIndex& keys = get_row_keys(facet);
+		vector<uint32_t> per_key(index.size(), 0);
+		for (const uint32_t& row : rows) {
+			for (const uint32_t* key = keys.begin(row); key != keys.end(row); ++key) {
+				++per_key[*key];
+			}
+		}
+
+		vector<pair<string, size_t>> counts;
+		for (uint32_t key = 0; key < per_key.size(); ++key) {
+			if (per_key[key] > 0) {
+				counts.emplace_back(index.get_keys()[key], per_key[key]);
+			}
+		}
+		return counts;
+	}
+
+	// Canonical key ids of every column row for facet
+	const ForwardIndex& get_row_keys(Facet facet) const {
+		ensure(LazyIndex::Facets);
+		return row_keys(facet);
+	}
+
+	// Pre-aggregated counts/sums/min/max/histograms per month x genre, developer and publisher
+	const AggregateCube& get_cube() const {
+		ensure(LazyIndex::Cube);
+		return cube;
+	}
+
+	const PostingIndex& get_index(Facet facet) const {
+		ensure((facet == Facet::Genre) ? LazyIndex::Genres : (facet == Facet::Developer) ? LazyIndex::Developers : LazyIndex::Publishers);
+		return (facet == Facet::Genre) ? genres : (facet == Facet::Developer) ? developers : publishers;
+	}
+
+	// appids of the games called name, compared like index keys (case and extra whitespace don't matter)
+	vector<appid> find_by_name(const string& name) {
+		ensure(LazyIndex::Columns);
+		string wanted = Game::normalize_entity(name);
+		vector<appid> ids;
+		for (const appid& id : columns.ids) {
+			if (Game::normalize_entity(get_name(id)) == wanted) {
+				ids.push_back(id);
+			}
+		}
+		return ids;
+	}
+
+	// The k games most like id, restricted to allowed when given (e.g. the result of the other search terms)
+	vector<SimilarGame> search_similar(appid id, size_t k, const set<appid>* allowed = nullptr) {
+		ensure(LazyIndex::Columns);
+		if (allowed == nullptr) {
+			return similar_rows(id, k, nullptr, 0);
+		}
+		RowBitmap rows(columns.size());
+		size_t num_rows = 0;
+		for (const appid& allowed_id : *allowed) {
+			size_t row = columns.row_of(allowed_id);
+			if (row < columns.size()) {
+				rows.set(static_cast<uint32_t>(row));
+				++num_rows;
+			}
+		}
+		return similar_rows(id, k, &rows, num_rows);
+	}
+
+	// "like Portal, released after 2015, >500 positive": the k games most like id that also match filter
+	vector<SimilarGame> search_similar(appid id, size_t k, const QuerySpec& filter) {
+		ensure(LazyIndex::Columns);
+		RowBitmap rows(columns.size());
+		vector<uint32_t> matches = match_rows(filter);
+		for (const uint32_t& row : matches) {
+			rows.set(row);
+		}
+		return similar_rows(id, k, &rows, matches.size());
+	}
+
+	// Row bitmaps for the keyword terms of a QuerySpec, empty if the keyword doesn't exist
+	RowBitmap genre_rows(const string& keyword) const {
+		ensure(LazyIndex::Genres);
+		return to_row_bitmap(genres, keyword);
+	}
+
+	RowBitmap developer_rows(const string& keyword) const {
+		ensure(LazyIndex::Developers);
+		return to_row_bitmap(developers, keyword);
+	}
+
+	RowBitmap publisher_rows(const string& keyword) const {
+		ensure(LazyIndex::Publishers);
+		return to_row_bitmap(publishers, keyword);
+	}
+
 	static set<appid> merge_n_sets(vector<set<appid>>& sets) {
 		auto start = std::chrono::steady_clock::now();
 		if (sets.size() == 1) {
@@ -195,11 +721,27 @@ public:
 		}
 
 		size_t num_ops = 0;
+
+		size_t smallest = 0;
+		for (size_t i = 1; i < sets.size(); ++i) {
+			if (sets[i].size() < sets[smallest].size()) {
+				smallest = i;
+			}
+		}
+		if (sets[smallest].size() >= PARALLEL_THRESHOLD && ThreadPool::shared().num_workers() > 0) {
+			set<appid> result = parallel_intersection(sets, smallest, num_ops);
+
+			auto end = std::chrono::steady_clock::now();
+			std::chrono::duration<double> elapsed_seconds = end - start;
+			cout << "[Merge Function] Took: " << elapsed_seconds.count() << "s to merge data" << endl;
+			cout << "[Merge Function] # of Operations: " << num_ops << endl;
+			return result;
+		}
 		
 		for (size_t i = 0; i < sets.size() - 1; ++i) {
 
 			size_t smaller_set = (sets[i].size() < sets[i + 1].size()) ? i : i + 1;
-			size_t larger_set = (sets[i].size() > sets[i + 1].size()) ? i : i + 1;
+			size_t larger_set = (smaller_set == i) ? i + 1 : i; // equal sizes must still pick two different sets
 
 			for (auto iter = sets[smaller_set].begin(); iter != sets[smaller_set].end(); ) {
 				if (sets[larger_set].count(*iter) == 0) {
@@ -259,177 +801,314 @@ public:
 		return smallest_set;
 	}
 
-	// TODO: leads to some extra (unwanted) results when searched
+	// Sorted-list intersection of every set, smallest first (sets come out of the queue in that order)
 	static set<appid> merge_n_sets_intersection(priority_queue<SetContainer, vector<SetContainer>, std::greater<SetContainer>>& sets) {
 		if (sets.size() == 1) {
 			return sets.top()._set;
 		}
 
-		set<appid> smallest_set = sets.top()._set;
+		vector<appid> v(sets.top()._set.begin(), sets.top()._set.end()); // a set iterates in order, already sorted
 		sets.pop();
-		vector<appid> v;
-		for (const auto& elem : smallest_set) {
-			v.push_back(elem);
-		}
-		std::sort(v.begin(), v.end());
 		auto start = std::chrono::steady_clock::now();
 
-		vector<appid>::iterator it;
-		while (!sets.empty()) {
-			
-			it = std::set_intersection(v.begin(), v.end(), sets.top()._set.begin(), sets.top()._set.end(), v.begin());
+		while (!sets.empty() && !v.empty()) {
+			vector<appid> next(sets.top()._set.begin(), sets.top()._set.end());
+			v = set_algebra::intersect(v, next); // v shrinks every round, extra ids from earlier rounds can't survive
 			sets.pop();
 		}
 		auto end = std::chrono::steady_clock::now();
 		std::chrono::duration<double> elapsed_seconds = end - start;
 		cout << "[Priority Queue Intersection Merge Function] Took: " << elapsed_seconds.count() << "s to merge data" << endl;
 
-		v.resize(it - v.begin());
 		set<appid> result;
-		for (it = v.begin(); it != v.end(); ++it) {
-			result.insert(*it);
+		for (const appid& id : v) {
+			result.insert(result.end(), id);
 		}
-		
 		return result;
 	}
 
 
-	string get_name(const appid& id) {
-		if (name_lookup.size() == 0) {
-			allocate_names();
-		}
-
-		if (name_lookup.find(id) == name_lookup.end()) {
+	// Views into the name arena, valid as long as the library
+	string_view get_name(const appid& id) const {
+		ensure(LazyIndex::Columns);
+		size_t row = columns.row_of(id);
+		if (row >= columns.size()) {
 			cout << "No games with id: \"" << id << "\" found!" << endl;
 			return "[error]";
 		}
-		
-		return name_lookup.at(id);
+		return name_of_row(static_cast<uint32_t>(row));
+	}
+
+	string_view name_of_row(uint32_t row) const {
+		ensure(LazyIndex::Names);
+		return string_view(name_arena).substr(name_offsets[row], name_offsets[row + 1] - name_offsets[row]);
+	}
+
+	// Column rows of ids in ascending appid order, ids that aren't in the library are left out
+	vector<uint32_t> rows_of(const set<appid>& ids) const {
+		ensure(LazyIndex::Columns);
+		vector<uint32_t> rows;
+		rows.reserve(ids.size());
+		for (const appid& id : ids) {
+			size_t row = columns.row_of(id);
+			if (row < columns.size()) {
+				rows.push_back(static_cast<uint32_t>(row));
+			}
+		}
+		return rows;
 	}
 
 	pair<Date, Date> get_date_bounds() const {
+		ensure(LazyIndex::Dates);
 		return date_bounds;
 	}
 
 	vector<string> get_developers_list() const {
-		return developers_list;
+		ensure(LazyIndex::Developers);
+		return developers.get_keys();
 	}
 
 	vector<string> get_publishers_list() const {
-		return publishers_list;
+		ensure(LazyIndex::Publishers);
+		return publishers.get_keys();
 	}
 
 	vector<string> get_genre_types() const {
-		return genre_types;
+		ensure(LazyIndex::Genres);
+		return genres.get_keys();
+	}
+
+	const GameColumns& get_columns() const {
+		ensure(LazyIndex::Columns);
+		return columns;
 	}
 
 private:
 
-	void allocate_games() {
+	vector<SimilarGame> similar_rows(appid id, size_t k, const RowBitmap* allowed, size_t num_allowed) {
+		ensure(LazyIndex::Similarity);
 		auto start = std::chrono::steady_clock::now();
-		ifstream steam_games(DATA_FILE); // hardcoded for ease of access, can fix later
-		string line;
 
-		getline(steam_games, line);
-		descriptors == std::move(allocate_descriptors(line));
-
-		int i = 0;
-		cout << "Reading csv file and allocating games";
-		while (getline(steam_games, line)) {
-			games.push_back(Game(line));
-			++i;
-			if (i % LOAD_INTERVAL == 0) { // "pretty animations"
-				cout << ".";
-			}
+		vector<SimilarGame> result;
+		size_t row = columns.row_of(id);
+		if (row >= columns.size()) {
+			cout << "No games with id: \"" << id << "\" found!" << endl;
+			return result;
 		}
-
-		cout << "Finished allocating games" << endl;
+		result = similarity->top_k(static_cast<uint32_t>(row), k, allowed, num_allowed);
 
 		auto end = std::chrono::steady_clock::now();
 		std::chrono::duration<double> elapsed_seconds = end - start;
-		cout << "  Took: " << elapsed_seconds.count() << "s to store data" << endl;
-
+		cout << "Search by similarity took: " << elapsed_seconds.count() << "s" << endl;
+		return result;
 	}
 
-	vector<string> allocate_descriptors(const string& line) {
-		vector<string> result;
-		string tmp = "";
-		for (size_t i = 0; i <= line.length(); ++i) {
-			if (i != line.length() && line[i] != ',') {
-				tmp += line[i];
-			}
-			else {
-				result.push_back(tmp);
-			}
+	// The range term of query with the lowest estimate and its bounds, nullptr if none is below INDEXED_SELECTIVITY
+	const RangeIndex* most_selective_range(const QuerySpec& query, int32_t& lo, int32_t& hi) const {
+		if (!query.has_price && !query.has_min_owners) {
+			return nullptr;
 		}
-		return result;
+		ensure(LazyIndex::Ranges);
+
+		const RangeIndex* best = nullptr;
+		double best_selectivity = INDEXED_SELECTIVITY;
+		if (query.has_price && price_index.selectivity(query.price_lo, query.price_hi) < best_selectivity) {
+			best = &price_index;
+			best_selectivity = price_index.selectivity(query.price_lo, query.price_hi);
+			lo = query.price_lo;
+			hi = query.price_hi;
+		}
+		if (query.has_min_owners && owners_index.selectivity(query.min_owners, INT32_MAX) < best_selectivity) {
+			best = &owners_index;
+			lo = query.min_owners;
+			hi = INT32_MAX;
+		}
+		return best;
 	}
 
-	void allocate_all_attributes() {
-		cout << "Allocating all attributes for search";
-		auto start = std::chrono::steady_clock::now();
-		int i = 0;
+	const ForwardIndex& row_keys(Facet facet) const {
+		return (facet == Facet::Genre) ? genre_keys : (facet == Facet::Developer) ? developer_keys : publisher_keys;
+	}
 
-		// using this method to get min/max date is a ~0.05s performance hit
-		priority_queue<Date, vector<Date>, std::greater<Date>>  min_date;
-		priority_queue<Date> max_date;
+	// Every appid in the library, ascending (the universe NOT is taken against)
+	vector<appid> sorted_ids() const {
+		ensure(LazyIndex::Columns);
+		vector<appid> ids(columns.ids.begin(), columns.ids.end());
+		if (!std::is_sorted(ids.begin(), ids.end())) {
+			std::sort(ids.begin(), ids.end());
+		}
+		return ids;
+	}
 
+	RowBitmap to_row_bitmap(const PostingIndex& index, const string& keyword) const {
+		ensure(LazyIndex::Columns);
+		RowBitmap bitmap(columns.size());
+		const CompressedPostingList* postings = index.find(keyword);
+		if (postings == nullptr) {
+			return bitmap;
+		}
+		postings->for_each([&](appid id) {
+			size_t row = columns.row_of(id);
+			if (row < columns.size()) {
+				bitmap.set(static_cast<uint32_t>(row));
+			}
+		});
+		return bitmap;
+	}
 
-		for (Game g : games) {
-			name_lookup.emplace(g.get_id(), g.get_name());
+	// Copies the appids of rows [begin_row, end_row) into a set, splitting big ranges across the thread pool
+	template <typename Key>
+	static set<appid> gather_ids(const vector<pair<Key, appid>>& rows, size_t begin_row, size_t end_row) {
+		if (end_row <= begin_row) {
+			return set<appid>();
+		}
 
+		vector<appid> ids(end_row - begin_row);
+		vector<pair<size_t, size_t>> runs; // sorted [lo, hi) runs of ids, one per morsel
+		std::mutex runs_lock;
 
-			Date tmpdate(g.get_attributes()[2]);
-			release_dates.emplace(tmpdate, g.get_id());
-			min_date.push(tmpdate);
-			max_date.push(tmpdate);
+		ThreadPool::shared().parallel_for(begin_row, end_row, MORSEL_SIZE, [&](size_t lo, size_t hi) {
+			for (size_t i = lo; i < hi; ++i) {
+				ids[i - begin_row] = rows[i].second;
+			}
+			std::sort(ids.begin() + (lo - begin_row), ids.begin() + (hi - begin_row));
+			std::lock_guard<std::mutex> guard(runs_lock);
+			runs.emplace_back(lo - begin_row, hi - begin_row);
+		});
+
+		// merge neighbouring runs pairwise until one sorted run is left, each merge of a level is its own task
+		std::sort(runs.begin(), runs.end());
+		while (runs.size() > 1) {
+			vector<pair<size_t, size_t>> merged((runs.size() + 1) / 2);
+			ThreadPool::shared().run_each(runs.size() / 2, [&](size_t r) {
+				const auto& left = runs[2 * r];
+				const auto& right = runs[2 * r + 1];
+				std::inplace_merge(ids.begin() + left.first, ids.begin() + left.second, ids.begin() + right.second);
+				merged[r] = { left.first, right.second };
+			});
+			if (runs.size() % 2 == 1) {
+				merged.back() = runs.back();
+			}
+			runs = std::move(merged);
+		}
 
-			vector<string> devs = std::move(Game::split_string(g.get_attributes()[3], ';'));
-			for (size_t j = 0; j < devs.size(); ++j) {
-				if (developers.count(devs[j]) == 1) {
-					developers.at(devs[j]).push_back(g.get_id());
+		set<appid> result;
+		for (const appid& id : ids) {
+			result.insert(result.end(), id); // ids are sorted, so hinted insert is constant time
+		}
+		return result;
+	}
+
+	// Probes every other set for each element of sets[smallest], one morsel of the smallest set per task
+	static set<appid> parallel_intersection(const vector<set<appid>>& sets, size_t smallest, size_t& num_ops) {
+		vector<appid> candidates(sets[smallest].begin(), sets[smallest].end());
+		vector<vector<appid>> survivors((candidates.size() + MORSEL_SIZE - 1) / MORSEL_SIZE);
+		std::atomic<size_t> ops{ 0 };
+
+		ThreadPool::shared().parallel_for(0, candidates.size(), MORSEL_SIZE, [&](size_t lo, size_t hi) {
+			size_t local_ops = 0;
+			for (size_t i = lo; i < hi; ++i) {
+				bool in_all = true;
+				for (size_t s = 0; s < sets.size() && in_all; ++s) {
+					if (s != smallest) {
+						in_all = sets[s].count(candidates[i]) == 1;
+						++local_ops;
+					}
 				}
-				else {
-					vector<appid> tmp = { g.get_id() };
-					developers.emplace(devs[j], tmp);
-					developers_list.push_back(devs[j]);
+				if (in_all) {
+					survivors[lo / MORSEL_SIZE].push_back(candidates[i]);
 				}
 			}
+			ops += local_ops;
+		});
 
-			vector<string> pubs = std::move(Game::split_string(g.get_attributes()[4], ';'));
-			for (size_t j = 0; j < pubs.size(); ++j) {
-				if (publishers.count(pubs[j]) == 1) {
-					publishers.at(pubs[j]).push_back(g.get_id());
-				}
-				else {
-					vector<appid> tmp = { g.get_id() };
-					publishers.emplace(pubs[j], tmp);
-					publishers_list.push_back(pubs[j]);
-				}
+		set<appid> result;
+		for (const vector<appid>& morsel : survivors) { // morsels are in order, so the output is still sorted
+			for (const appid& id : morsel) {
+				result.insert(result.end(), id);
 			}
+		}
+		num_ops = ops;
+		return result;
+	}
 
-			vector<string> tags = std::move(Game::process_tags(g.get_attributes()[5]));
-			for (size_t j = 0; j < tags.size(); ++j) {
-				if (genres.count(tags[j]) == 1) {
-					genres.at(tags[j]).push_back(g.get_id());
-				}
-				else {
-					vector<appid> tmp = { g.get_id() };
-					genres.emplace(tags[j], tmp);
-					genre_types.push_back(tags[j]);
-				}
+	void allocate_games() {
+		games = read_games(DATA_FILE, descriptors); // hardcoded for ease of access, can fix later
+	}
+
+	// in the order the search prompts ask for them, analytics last
+	static const vector<LazyIndex>& warm_up_order() {
+		static const vector<LazyIndex> order = { LazyIndex::Dates, LazyIndex::Developers, LazyIndex::Publishers,
+			LazyIndex::Genres, LazyIndex::Reviews, LazyIndex::Names, LazyIndex::Columns, LazyIndex::Facets, LazyIndex::Ranges, LazyIndex::Cube,
+			LazyIndex::Similarity };
+		return order;
+	}
+
+	/*
+	* Standard and Compact build every index before the constructor returns. Lazy only starts the warm-up thread,
+	*	so the library answers as soon as the csv is read: a query ensures the indexes it reads, waiting just for
+	*	those (or for the warm-up to finish the one it's on), and the rest keep building in the background.
+	*/
+	void build_indexes(LibraryMode mode) {
+		lazy.define(static_cast<size_t>(LazyIndex::Names), [this] { allocate_names(); });
+		lazy.define(static_cast<size_t>(LazyIndex::Dates), [this] { allocate_dates(); });
+		lazy.define(static_cast<size_t>(LazyIndex::Reviews), [this] { allocate_reviews(); });
+		lazy.define(static_cast<size_t>(LazyIndex::Columns), [this] { allocate_columns(); });
+		lazy.define(static_cast<size_t>(LazyIndex::Developers), [this] { allocate_developers(); });
+		lazy.define(static_cast<size_t>(LazyIndex::Publishers), [this] { allocate_publishers(); });
+		lazy.define(static_cast<size_t>(LazyIndex::Genres), [this] { allocate_genres(); });
+		lazy.define(static_cast<size_t>(LazyIndex::Facets), [this] { allocate_facets(); });
+		lazy.define(static_cast<size_t>(LazyIndex::Ranges), [this] { allocate_ranges(); });
+		lazy.define(static_cast<size_t>(LazyIndex::Cube), [this] { allocate_cube(); });
+		lazy.define(static_cast<size_t>(LazyIndex::Similarity), [this] { allocate_similarity(); });
+
+		if (mode == LibraryMode::Lazy) {
+			vector<size_t> order;
+			for (const LazyIndex& index : warm_up_order()) {
+				order.push_back(static_cast<size_t>(index));
 			}
+			lazy.warm_up(std::move(order));
+			return;
+		}
+
+		allocate_all_attributes();
+		if (mode == LibraryMode::Compact) {
+			compact();
+		}
+	}
 
-			positive_reviews.emplace(stoi(g.get_attributes()[6]), g.get_id());
+	void ensure(LazyIndex index) const {
+		lazy.ensure(static_cast<size_t>(index));
+	}
 
-			++i;
-			if (i % LOAD_INTERVAL == 0) { // "pretty animations"
-				cout << ".";
+	bool is_ready(LazyIndex index) const {
+		return lazy.is_ready(static_cast<size_t>(index));
+	}
+
+	// Everything that's built from the Game rows, i.e. all but the similarity index
+	void ensure_row_indexes() const {
+		for (const LazyIndex& index : warm_up_order()) {
+			if (index != LazyIndex::Similarity) {
+				ensure(index);
 			}
 		}
+	}
 
-		date_bounds.first = min_date.top();
-		date_bounds.second = max_date.top();
+	void allocate_all_attributes() {
+		cout << "Allocating all attributes for search";
+		auto start = std::chrono::steady_clock::now();
+
+		// independent indexes build side by side on the pool, the cube waits for the ones it reads
+		const vector<LazyIndex>& order = warm_up_order();
+		ThreadPool::shared().run_each(order.size(), [&](size_t i) {
+			if (order[i] == LazyIndex::Similarity) {
+				return;
+			}
+			bool was_quiet = LazyIndexes::quiet_builds();
+			LazyIndexes::quiet_builds() = true; // one line for the lot instead of one per index
+			ensure(order[i]);
+			LazyIndexes::quiet_builds() = was_quiet;
+		});
 
 		cout << "Finished allocating attributes" << endl;
 		auto end = std::chrono::steady_clock::now();
@@ -437,73 +1116,247 @@ private:
 		cout << "  Took: " << elapsed_seconds.count() << "s to store data" << endl;
 	}
 
-
-	// Redudnant Method, used for "dynamic" allocation
-	void allocate_names() {
-		cout << "Allocating names set for search";
+	// Runs build(tick), printing progress and how long it took unless this thread builds quietly
+	template <typename Fn>
+	static void timed_allocation(const string& what, Fn&& build) {
+		bool report = !LazyIndexes::quiet_builds();
+		if (report) {
+			cout << "Allocating " << what << " set for search";
+		}
 		auto start = std::chrono::steady_clock::now();
 		int i = 0;
 
-		for (Game g : games) {
-			name_lookup.emplace(g.get_id(), g.get_name());
-
+		build([&] {
 			++i;
-			if (i % LOAD_INTERVAL == 0) { // "pretty animations"
+			if (report && i % LOAD_INTERVAL == 0) { // "pretty animations"
 				cout << ".";
 			}
+		});
+
+		if (report) {
+			cout << "Finished allocating " << what << endl;
+			auto end = std::chrono::steady_clock::now();
+			std::chrono::duration<double> elapsed_seconds = end - start;
+			cout << "  Took: " << elapsed_seconds.count() << "s to store data" << endl;
 		}
+	}
 
-	
-		cout << "Finished allocating names" << endl;
-		auto end = std::chrono::steady_clock::now();
-		std::chrono::duration<double> elapsed_seconds = end - start;
-		cout << "  Took: " << elapsed_seconds.count() << "s to store data" << endl;
+	// Builders, each run once through ensure()
+
+	void allocate_names() {
+		timed_allocation("names", [&](auto tick) {
+			size_t bytes = 0;
+			for (const Game& g : games) {
+				bytes += g.get_name().size();
+			}
+			name_arena.reserve(bytes);
+			name_offsets.reserve(games.size() + 1);
+			name_offsets.push_back(0);
+			for (const Game& g : games) {
+				name_arena += g.get_name();
+				name_offsets.push_back(static_cast<uint32_t>(name_arena.size()));
+				tick();
+			}
+		});
 	}
 
-	// Redudnant Method, used for "dynamic" allocation
 	void allocate_dates() {
-		cout << "Allocating release dates set for search";
-		auto start = std::chrono::steady_clock::now();
-		int i = 0;
+		timed_allocation("release dates", [&](auto tick) {
+			release_dates.reserve(games.size());
+			for (const Game& g : games) {
+				release_dates.emplace_back(Date(g.get_attributes()[2]), g.get_id());
+				tick();
+			}
+			std::sort(release_dates.begin(), release_dates.end());
+
+			if (!release_dates.empty()) {
+				date_bounds.first = release_dates.front().first;
+				date_bounds.second = release_dates.back().first;
+			}
+		});
+	}
 
+	void allocate_reviews() {
+		timed_allocation("positive reviews", [&](auto tick) {
+			positive_reviews.reserve(games.size());
+			for (const Game& g : games) {
+				positive_reviews.emplace_back(stoi(g.get_attributes()[6]), g.get_id());
+				tick();
+			}
+			std::sort(positive_reviews.begin(), positive_reviews.end());
+		});
+	}
 
-		// using this method to get min/max date is a ~0.05s performance hit
-		priority_queue<Date, vector<Date>, std::greater<Date>>  min_date;
-		priority_queue<Date> max_date;
+	void allocate_columns() {
+		timed_allocation("columns", [&](auto tick) {
+			for (const Game& g : games) {
+				columns.append(g);
+				tick();
+			}
+		});
+	}
 
+	void allocate_developers() {
+		allocate_keywords(developers, 3, "developers");
+	}
 
-		for (Game g : games) {
-			
-			Date tmpdate(g.get_attributes()[2]);
+	void allocate_publishers() {
+		allocate_keywords(publishers, 4, "publishers");
+	}
 
-			release_dates.emplace(tmpdate, g.get_id());
-			min_date.push(tmpdate);
-			max_date.push(tmpdate);
+	void allocate_genres() {
+		allocate_keywords(genres, 5, "genres");
+	}
 
-			++i;
-			if (i % LOAD_INTERVAL == 0) { // "pretty animations"
-				cout << ".";
+	// Posting lists of the ';' separated values in column attribute
+	void allocate_keywords(PostingIndex& index, size_t attribute, const string& what) {
+		timed_allocation(what, [&](auto tick) {
+			for (const Game& g : games) {
+				for (const string& keyword : Game::split_list(g.get_attributes()[attribute])) {
+					index.add(keyword, g.get_id());
+				}
+				tick();
 			}
+			index.finalize();
+		});
+	}
+
+	void allocate_facets() {
+		ensure(LazyIndex::Columns);
+		ensure(LazyIndex::Developers);
+		ensure(LazyIndex::Publishers);
+		ensure(LazyIndex::Genres);
+
+		timed_allocation("facets", [&](auto tick) {
+			auto row_of = [&](appid id) { return columns.row_of(id); };
+			developer_keys = ForwardIndex(developers, columns.size(), row_of);
+			publisher_keys = ForwardIndex(publishers, columns.size(), row_of);
+			genre_keys = ForwardIndex(genres, columns.size(), row_of);
+			tick();
+		});
+	}
+
+	void allocate_ranges() {
+		ensure(LazyIndex::Columns);
+
+		timed_allocation("price and owners ranges", [&](auto tick) {
+			price_index = RangeIndex(columns.price_cents);
+			owners_index = RangeIndex(columns.owners_low);
+			tick();
+		});
+	}
+
+	// Needs the row -> key lists and the parsed ratings/prices, so the indexes they come from go first
+	void allocate_cube() {
+		ensure(LazyIndex::Facets);
+
+		timed_allocation("aggregates", [&](auto tick) {
+			for (uint32_t row = 0; row < columns.size(); ++row) {
+				for_each_cube_entry(row, [&](Facet facet, const vector<uint32_t>& keys, const Date& release, uint32_t positive, uint32_t negative, uint32_t price) {
+					cube.add(facet, keys, release, positive, negative, price);
+				}, [&](const Date& release, uint32_t positive, uint32_t negative, uint32_t price) {
+					cube.add_total(release, positive, negative, price);
+				});
+				tick();
+			}
+			cube.finalize();
+		});
+	}
+
+	// facet_entry(facet, keys, release, positive, negative, price) per facet and total_entry(...) for the totals of row
+	template <typename FacetEntry, typename TotalEntry>
+	void for_each_cube_entry(uint32_t row, FacetEntry&& facet_entry, TotalEntry&& total_entry) const {
+		Date release = GameColumns::to_date(columns.release_ymd[row]);
+		uint32_t positive = static_cast<uint32_t>(columns.positive_ratings[row]);
+		uint32_t negative = static_cast<uint32_t>(columns.negative_ratings[row]);
+		uint32_t price = static_cast<uint32_t>(columns.price_cents[row]);
+		total_entry(release, positive, negative, price);
+		for (const Facet& facet : { Facet::Developer, Facet::Publisher, Facet::Genre }) {
+			const ForwardIndex& keys = row_keys(facet);
+			facet_entry(facet, vector<uint32_t>(keys.begin(row), keys.end(row)), release, positive, negative, price);
 		}
+	}
 
-		date_bounds.first = min_date.top();
-		date_bounds.second = max_date.top();
+	// A cube cell counted again from the games released in its month
+	CubeCell recount(const AggregateCube::CellRef& cell) const {
+		CubeCell result;
+		auto first = std::partition_point(release_dates.begin(), release_dates.end(),
+			[&](const pair<Date, appid>& entry) { return AggregateCube::period(entry.first) < cell.period; });
+		for (auto iter = first; iter != release_dates.end() && AggregateCube::period(iter->first) == cell.period; ++iter) {
+			uint32_t row = static_cast<uint32_t>(columns.row_of(iter->second));
+			if (!cell.total) {
+				const ForwardIndex& keys = row_keys(cell.facet);
+				if (!std::binary_search(keys.begin(row), keys.end(row), cell.key)) {
+					continue;
+				}
+			}
+			result.add(static_cast<uint32_t>(columns.positive_ratings[row]), static_cast<uint32_t>(columns.negative_ratings[row]),
+				static_cast<uint32_t>(columns.price_cents[row]));
+		}
+		return result;
+	}
 
-		
-		cout << "Finished allocating release dates" << endl;
+	// Sorted canonical ids of the ';' separated values of field, values the index doesn't have are left out
+	static vector<uint32_t> key_ids_of(const PostingIndex& index, const string& field) {
+		vector<uint32_t> ids;
+		for (const string& value : Game::split_list(field)) {
+			uint32_t id = index.id_of(value);
+			if (id != PostingIndex::NO_KEY) {
+				ids.push_back(id);
+			}
+		}
+		std::sort(ids.begin(), ids.end());
+		ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+		return ids;
+	}
+
+	// (keyword, appid) of every ';' separated value in column attribute of rows
+	static vector<pair<string, appid>> keyword_entries(const vector<Game>& rows, size_t attribute) {
+		vector<pair<string, appid>> entries;
+		for (const Game& g : rows) {
+			for (string& keyword : Game::split_list(g.get_attributes()[attribute])) {
+				entries.emplace_back(std::move(keyword), g.get_id());
+			}
+		}
+		return entries;
+	}
+
+	// Drops the entries of removed (sorted) appids from rows sorted by (key, appid) and merges added in
+	template <typename Key>
+	static void patch_sorted(vector<pair<Key, appid>>& rows, const vector<appid>& removed, vector<pair<Key, appid>> added) {
+		rows.erase(std::remove_if(rows.begin(), rows.end(), [&](const pair<Key, appid>& row) {
+			return std::binary_search(removed.begin(), removed.end(), row.second);
+		}), rows.end());
+		std::sort(added.begin(), added.end());
+		size_t middle = rows.size();
+		rows.insert(rows.end(), added.begin(), added.end());
+		std::inplace_merge(rows.begin(), rows.begin() + middle, rows.end());
+	}
+
+	void allocate_similarity() {
+		ensure(LazyIndex::Columns);
+		ensure(LazyIndex::Developers);
+		ensure(LazyIndex::Publishers);
+		ensure(LazyIndex::Genres);
+
+		auto start = std::chrono::steady_clock::now();
+		similarity = std::make_unique<SimilarityIndex>(columns, genres, developers, publishers);
 		auto end = std::chrono::steady_clock::now();
 		std::chrono::duration<double> elapsed_seconds = end - start;
-		cout << "  Took: " << elapsed_seconds.count() << "s to store data" << endl;
+		if (!LazyIndexes::quiet_builds()) {
+			cout << "  Took: " << elapsed_seconds.count() << "s to build the similarity index" << endl;
+		}
 	}
 
-	multimap<Date, appid>::iterator find_minimum_valid_date(const string& s_date) {
+	// Returns the first row of release_dates on or after s_date
+	size_t find_minimum_valid_date(const string& s_date) {
 		Date date;
 		try {
 			date = Date(s_date);
 		}
 		catch (exception& e) {
 			cout << "invalid date: " << e.what() << ". Will switch to default minimum date" << endl;
-			return release_dates.find(date_bounds.first);
+			return 0;
 		}
 
 		if (date < date_bounds.first) {
@@ -512,14 +1365,12 @@ private:
 			date = date_bounds.first;
 		}
 
-		while (release_dates.find(date) == release_dates.end()) {
-			++date;
-		}
-
-		return release_dates.find(date);
+		return std::lower_bound(release_dates.begin(), release_dates.end(), date,
+			[](const pair<Date, appid>& row, const Date& d) { return row.first < d; }) - release_dates.begin();
 	}
 
-	multimap<Date, appid>::iterator find_maximum_valid_date(const string& s_date) {
+	// Returns one past the last row of release_dates on or before s_date
+	size_t find_maximum_valid_date(const string& s_date) {
 		Date date;
 
 		try {
@@ -527,7 +1378,7 @@ private:
 		}
 		catch (exception& e) {
 			cout << "Invalid date: " << e.what() << ". Will switch to default maximum date" << endl;
-			return release_dates.find(date_bounds.second);
+			return release_dates.size();
 		}
 
 		if (date > date_bounds.second) {
@@ -536,105 +1387,7 @@ private:
 			date = date_bounds.second;
 		}
 		
-		while (release_dates.find(date) == release_dates.end()) {
-			--date;
-		}
-
-		return release_dates.find(date);
-	}
-
-	// Redudnant Method, used for "dynamic" allocation
-	void allocate_developers() {
-		cout << "Allocating developers set for search";
-		auto start = std::chrono::steady_clock::now();
-		int i = 0;
-
-		for (Game g : games) {
-			vector<string> devs = std::move(Game::split_string(g.get_attributes()[3], ';'));
-			for (size_t j = 0; j < devs.size(); ++j) {	
-				if (developers.count(devs[j]) == 1) {
-					developers.at(devs[j]).push_back(g.get_id());
-				}
-				else {
-					vector<appid> tmp = { g.get_id() };
-					developers.emplace(devs[j], tmp);
-					developers_list.push_back(devs[j]);
-				}
-			}
-
-			++i;
-			if (i % LOAD_INTERVAL == 0) { // "pretty animations"
-				cout << ".";
-			}
-		}
-		cout << "Finished allocating developers" << endl;
-		auto end = std::chrono::steady_clock::now();
-		std::chrono::duration<double> elapsed_seconds = end - start;
-		cout << "  Took: " << elapsed_seconds.count() << "s to store data" << endl;
+		return std::upper_bound(release_dates.begin(), release_dates.end(), date,
+			[](const Date& d, const pair<Date, appid>& row) { return d < row.first; }) - release_dates.begin();
 	}
-
-	// Redudnant Method, used for "dynamic" allocation
-	void allocate_publishers() {
-		cout << "Allocating publishers set for search";
-		auto start = std::chrono::steady_clock::now();
-		int i = 0;
-
-		for (Game g : games) {
-			vector<string> pubs = std::move(Game::split_string(g.get_attributes()[4], ';'));
-			for (size_t j = 0; j < pubs.size(); ++j) {
-				if (publishers.count(pubs[j]) == 1) {
-					publishers.at(pubs[j]).push_back(g.get_id());
-				}
-				else {
-					vector<appid> tmp = { g.get_id() };
-					publishers.emplace(pubs[j], tmp);
-					publishers_list.push_back(pubs[j]);
-				}
-			}
-
-			++i;
-			if (i % LOAD_INTERVAL == 0) { // "pretty animations"
-				cout << ".";
-			}
-		}
-
-		cout << "Finished allocating publishers" << endl;
-		auto end = std::chrono::steady_clock::now();
-		std::chrono::duration<double> elapsed_seconds = end - start;
-		cout << "  Took: " << elapsed_seconds.count() << "s to store data" << endl;
-	}
-
-	// Redudnant Method, used for "dynamic" allocation
-	void allocate_genres() {
-		cout << "Allocating genres set for search";
-		auto start = std::chrono::steady_clock::now();
-		int i = 0;
-
-		for (Game g : games) {
-			vector<string> tags = std::move(Game::process_tags(g.get_attributes()[5]));
-
-			for (size_t j = 0; j < tags.size(); ++j) {
-				if (genres.count(tags[j]) == 1) {
-					genres.at(tags[j]).push_back(g.get_id());
-				}
-				else {
-					vector<appid> tmp = { g.get_id() };
-					genres.emplace(tags[j], tmp);
-					genre_types.push_back(tags[j]);
-				}
-			}
-
-			++i;
-			if (i % LOAD_INTERVAL == 0) { // "pretty animations"
-				cout << ".";
-			}
-		}
-
-		cout << "Finished allocating genres" << endl;
-		auto end = std::chrono::steady_clock::now();
-		std::chrono::duration<double> elapsed_seconds = end - start;
-		cout << "  Took: " << elapsed_seconds.count() << "s to store data" << endl;
-	}
-
-
 };
\ No newline at end of file
@@ -0,0 +1,113 @@
+#pragma once
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using std::function;
+using std::unique_ptr;
+using std::vector;
+
+/*
+* Indexes that are built on first use
+*	Each index has a builder and a once_flag. ensure() runs the builder the first time anyone asks for the index,
+*	callers that ask while it's being built wait for it, everyone after that returns straight away. Builders may
+*	ensure() other indexes they depend on. A builder that throws leaves its index unbuilt, the next ensure() retries.
+*
+*	warm_up() starts one background thread that ensures the indexes in priority order, so the first queries only
+*	wait for what they need while the heavier indexes finish behind them.
+*
+* Methods
+*	define() - set the builder of index i
+*	ensure() - build index i if it isn't yet, returns once it's ready
+*	is_ready() - true once index i is built, never blocks
+*	warm_up() - build the given indexes in order on a background thread
+*	stop() - let the warm-up finish its current index and join it
+*	reset() - forget that index i was built, the next ensure() builds it again
+*/
+class LazyIndexes {
+	struct Slot {
+		std::once_flag once;
+		std::atomic<bool> ready{ false };
+		function<void()> build;
+	};
+
+	vector<unique_ptr<Slot>> slots; // once_flag can't move, so slots live on the heap
+	std::thread warmer;
+	std::atomic<bool> stopping{ false };
+
+public:
+
+	explicit LazyIndexes(size_t count) {
+		for (size_t i = 0; i < count; ++i) {
+			slots.push_back(std::make_unique<Slot>());
+		}
+	}
+
+	~LazyIndexes() {
+		stop();
+	}
+
+	LazyIndexes(const LazyIndexes&) = delete;
+	LazyIndexes& operator=(const LazyIndexes&) = delete;
+
+	// True on threads whose builds shouldn't print progress (the warm-up thread, bulk builds...)
+	static bool& quiet_builds() {
+		static thread_local bool quiet = false;
+		return quiet;
+	}
+
+	void define(size_t i, function<void()> build) {
+		slots[i]->build = std::move(build);
+	}
+
+	void ensure(size_t i) const {
+		Slot& slot = *slots[i];
+		if (slot.ready.load(std::memory_order_acquire)) {
+			return;
+		}
+		std::call_once(slot.once, [&slot] {
+			slot.build();
+			slot.ready.store(true, std::memory_order_release);
+		});
+	}
+
+	bool is_ready(size_t i) const {
+		return slots[i]->ready.load(std::memory_order_acquire);
+	}
+
+	void warm_up(vector<size_t> order) {
+		stop();
+		stopping = false;
+		warmer = std::thread([this, order = std::move(order)] {
+			quiet_builds() = true;
+			for (const size_t& i : order) {
+				if (stopping) {
+					return;
+				}
+				try {
+					ensure(i);
+				}
+				catch (...) {
+					// left unbuilt, whoever needs it next rebuilds it and gets the error
+				}
+			}
+		});
+	}
+
+	// Only while nothing else can ensure() i (e.g. after stop(), with no queries running), once_flag can't be re-armed
+	void reset(size_t i) {
+		function<void()> build = std::move(slots[i]->build);
+		slots[i] = std::make_unique<Slot>();
+		slots[i]->build = std::move(build);
+	}
+
+	void stop() {
+		stopping = true;
+		if (warmer.joinable()) {
+			warmer.join();
+		}
+	}
+};
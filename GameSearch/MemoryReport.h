@@ -0,0 +1,67 @@
+#pragma once
+#include <cstdint>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+using std::ostream;
+using std::pair;
+using std::string;
+using std::vector;
+
+/*
+* Estimated heap bytes of the containers the library is built from
+*	Counts what the container allocates (capacity, not size), plus the heap buffers of strings that don't fit
+*	in the small string buffer. Allocator headers and padding aren't visible from here and aren't counted.
+*/
+namespace memory_usage {
+
+	// 0 for strings stored inside the object itself (small string optimization)
+	inline size_t of(const string& s) {
+		const char* data = s.data();
+		const char* self = reinterpret_cast<const char*>(&s);
+		return (data >= self && data < self + sizeof(string)) ? 0 : s.capacity() + 1;
+	}
+
+	template <typename T>
+	size_t of(const vector<T>& v) {
+		return v.capacity() * sizeof(T);
+	}
+
+	inline size_t of(const vector<string>& v) {
+		size_t bytes = v.capacity() * sizeof(string);
+		for (const string& s : v) {
+			bytes += of(s);
+		}
+		return bytes;
+	}
+}
+
+/*
+* Bytes per structure of a GameLibrary, see GameLibrary::memory_report()
+*	Entries are "index/part" names in the order they were added.
+*/
+struct MemoryReport {
+	vector<pair<string, size_t>> entries;
+
+	void add(const string& name, size_t bytes) {
+		entries.emplace_back(name, bytes);
+	}
+
+	size_t total() const {
+		size_t bytes = 0;
+		for (const auto& entry : entries) {
+			bytes += entry.second;
+		}
+		return bytes;
+	}
+
+	void print(ostream& out) const {
+		for (const auto& entry : entries) {
+			out << "  " << std::left << std::setw(32) << entry.first << std::right << std::setw(12) << entry.second << " bytes" << std::endl;
+		}
+		out << "  " << std::left << std::setw(32) << "total" << std::right << std::setw(12) << total() << " bytes" << std::endl;
+	}
+};
@@ -0,0 +1,311 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include "ScanEngine.h"
+#include <unordered_map>
+#include <vector>
+
+using std::unique_ptr;
+using std::unordered_map;
+using std::vector;
+
+// One bit per GameColumns row, used for keyword terms (genre, developer, publisher) inside a row loop
+struct RowBitmap {
+	vector<uint64_t> words;
+
+	RowBitmap() {}
+	explicit RowBitmap(size_t num_rows) : words((num_rows + 63) / 64, 0) {}
+
+	void set(uint32_t row) {
+		words[row >> 6] |= uint64_t(1) << (row & 63);
+	}
+
+	bool test(uint32_t row) const {
+		return (words[row >> 6] >> (row & 63)) & 1;
+	}
+};
+
+/*
+* A conjunctive query over GameColumns. Every has_* flag switches on one term, all active terms are ANDed.
+* Dates are yyyymmdd (GameColumns::to_ymd) and prices are in cents, both ranges are inclusive.
+*/
+struct QuerySpec {
+	bool has_date = false;
+	int32_t date_lo = 0;
+	int32_t date_hi = 0;
+
+	bool has_genre = false;
+	RowBitmap genre;
+
+	bool has_developer = false;
+	RowBitmap developer;
+
+	bool has_publisher = false;
+	RowBitmap publisher;
+
+	bool has_min_positive = false;
+	int32_t min_positive = 0;
+
+	bool has_price = false;
+	int32_t price_lo = 0;
+	int32_t price_hi = 0;
+
+	bool has_min_owners = false;
+	int32_t min_owners = 0; // compared against the low end of the owners bucket
+
+	bool has_ratio = false;
+	int32_t min_percent = 0;
+
+	uint32_t shape() const;
+};
+
+/*
+* Terms
+*	Each term is a stateless struct with a shape bit and a static test(), so a list of terms can be fused into
+*	one loop by the compiler. test() uses & instead of && to keep the fused loop branch free.
+*/
+namespace pipeline {
+
+	struct DateRange {
+		static constexpr uint32_t bit = 1 << 0;
+		static bool active(const QuerySpec& q) { return q.has_date; }
+		static bool test(const GameColumns& c, const QuerySpec& q, uint32_t r) {
+			return (c.release_ymd[r] >= q.date_lo) & (c.release_ymd[r] <= q.date_hi);
+		}
+	};
+
+	struct Genre {
+		static constexpr uint32_t bit = 1 << 1;
+		static bool active(const QuerySpec& q) { return q.has_genre; }
+		static bool test(const GameColumns&, const QuerySpec& q, uint32_t r) {
+			return q.genre.test(r);
+		}
+	};
+
+	struct Developer {
+		static constexpr uint32_t bit = 1 << 2;
+		static bool active(const QuerySpec& q) { return q.has_developer; }
+		static bool test(const GameColumns&, const QuerySpec& q, uint32_t r) {
+			return q.developer.test(r);
+		}
+	};
+
+	struct Publisher {
+		static constexpr uint32_t bit = 1 << 3;
+		static bool active(const QuerySpec& q) { return q.has_publisher; }
+		static bool test(const GameColumns&, const QuerySpec& q, uint32_t r) {
+			return q.publisher.test(r);
+		}
+	};
+
+	struct MinPositive {
+		static constexpr uint32_t bit = 1 << 4;
+		static bool active(const QuerySpec& q) { return q.has_min_positive; }
+		static bool test(const GameColumns& c, const QuerySpec& q, uint32_t r) {
+			return c.positive_ratings[r] >= q.min_positive;
+		}
+	};
+
+	struct PriceRange {
+		static constexpr uint32_t bit = 1 << 5;
+		static bool active(const QuerySpec& q) { return q.has_price; }
+		static bool test(const GameColumns& c, const QuerySpec& q, uint32_t r) {
+			return (c.price_cents[r] >= q.price_lo) & (c.price_cents[r] <= q.price_hi);
+		}
+	};
+
+	struct MinOwners {
+		static constexpr uint32_t bit = 1 << 6;
+		static bool active(const QuerySpec& q) { return q.has_min_owners; }
+		static bool test(const GameColumns& c, const QuerySpec& q, uint32_t r) {
+			return c.owners_low[r] >= q.min_owners;
+		}
+	};
+
+	struct PositiveRatio {
+		static constexpr uint32_t bit = 1 << 7;
+		static bool active(const QuerySpec& q) { return q.has_ratio; }
+		static bool test(const GameColumns& c, const QuerySpec& q, uint32_t r) {
+			return int64_t(c.positive_ratings[r]) * (100 - q.min_percent) >= int64_t(c.negative_ratings[r]) * q.min_percent;
+		}
+	};
+
+	// Conjunction of terms, test() inlines every term into the caller's loop. All<> keeps every row.
+	template <typename... Terms>
+	struct All {
+		static constexpr uint32_t shape = (Terms::bit | ... | 0u);
+		static bool test([[maybe_unused]] const GameColumns& c, [[maybe_unused]] const QuerySpec& q, [[maybe_unused]] uint32_t r) {
+			return (Terms::test(c, q, r) & ... & true);
+		}
+	};
+
+	template <typename Query>
+	vector<uint32_t> fused_scan(const GameColumns& c, const QuerySpec& q) {
+		return parallel_select(c.size(), [&](uint32_t begin, uint32_t end, uint32_t* out) {
+			size_t n = 0;
+			for (uint32_t r = begin; r < end; ++r) {
+				out[n] = r;
+				n += Query::test(c, q, r);
+			}
+			return n;
+		});
+	}
+
+	// Same loop over candidate rows (ascending) another index already narrowed the query to
+	template <typename Query>
+	vector<uint32_t> fused_filter(const GameColumns& c, const QuerySpec& q, const vector<uint32_t>& candidates) {
+		vector<uint32_t> out(candidates.size());
+		size_t n = 0;
+		for (const uint32_t& r : candidates) {
+			out[n] = r;
+			n += Query::test(c, q, r);
+		}
+		out.resize(n);
+		return out;
+	}
+
+	// Generic interpreter: one virtual call per row per term, used for shapes nobody registered
+	class RowPredicate {
+	public:
+		virtual ~RowPredicate() {}
+		virtual bool matches(const GameColumns& c, uint32_t r) const = 0;
+	};
+
+	template <typename Term>
+	class TermPredicate : public RowPredicate {
+		const QuerySpec& q;
+	public:
+		explicit TermPredicate(const QuerySpec& q) : q(q) {}
+		bool matches(const GameColumns& c, uint32_t r) const override {
+			return Term::test(c, q, r);
+		}
+	};
+
+	template <typename... Terms>
+	struct TermList {
+		static uint32_t shape(const QuerySpec& q) {
+			return ((Terms::active(q) ? Terms::bit : 0u) | ... | 0u);
+		}
+
+		static vector<unique_ptr<RowPredicate>> compile(const QuerySpec& q) {
+			vector<unique_ptr<RowPredicate>> predicates;
+			((Terms::active(q) ? predicates.push_back(std::make_unique<TermPredicate<Terms>>(q)) : void()), ...);
+			return predicates;
+		}
+	};
+
+	using AllTerms = TermList<DateRange, Genre, Developer, Publisher, MinPositive, PriceRange, MinOwners, PositiveRatio>;
+
+	inline vector<uint32_t> interpret(const GameColumns& c, const QuerySpec& q) {
+		vector<unique_ptr<RowPredicate>> predicates = AllTerms::compile(q);
+		return parallel_select(c.size(), [&](uint32_t begin, uint32_t end, uint32_t* out) {
+			size_t n = 0;
+			for (uint32_t r = begin; r < end; ++r) {
+				bool keep = true;
+				for (size_t p = 0; p < predicates.size() && keep; ++p) {
+					keep = predicates[p]->matches(c, r);
+				}
+				out[n] = r;
+				n += keep;
+			}
+			return n;
+		});
+	}
+
+	inline vector<uint32_t> interpret(const GameColumns& c, const QuerySpec& q, const vector<uint32_t>& candidates) {
+		vector<unique_ptr<RowPredicate>> predicates = AllTerms::compile(q);
+		vector<uint32_t> out;
+		for (const uint32_t& r : candidates) {
+			bool keep = true;
+			for (size_t p = 0; p < predicates.size() && keep; ++p) {
+				keep = predicates[p]->matches(c, r);
+			}
+			if (keep) {
+				out.push_back(r);
+			}
+		}
+		return out;
+	}
+}
+
+inline uint32_t QuerySpec::shape() const {
+	return pipeline::AllTerms::shape(*this);
+}
+
+/*
+* Maps a query shape (which terms are active) to a fused instantiation
+*	Our most common shapes are registered below; anything else goes to pipeline::interpret().
+*/
+class PipelineRegistry {
+	typedef vector<uint32_t>(*Scan)(const GameColumns&, const QuerySpec&);
+	typedef vector<uint32_t>(*Filter)(const GameColumns&, const QuerySpec&, const vector<uint32_t>&);
+
+	struct Pipeline {
+		Scan scan;		// every row
+		Filter filter;	// candidate rows only
+	};
+	unordered_map<uint32_t, Pipeline> pipelines;
+
+	template <typename... Terms>
+	void add() {
+		pipelines[pipeline::All<Terms...>::shape] = {
+			&pipeline::fused_scan<pipeline::All<Terms...>>, &pipeline::fused_filter<pipeline::All<Terms...>> };
+	}
+
+public:
+
+	PipelineRegistry() {
+		using namespace pipeline;
+
+		// search prompt: date bounds, genre, review threshold and every subset of them
+		add<>();
+		add<DateRange>();
+		add<Genre>();
+		add<MinPositive>();
+		add<DateRange, Genre>();
+		add<DateRange, MinPositive>();
+		add<Genre, MinPositive>();
+		add<DateRange, Genre, MinPositive>();
+
+		// the rest of the prompt: a studio alone, a studio's releases, review ratio
+		add<Developer>();
+		add<Publisher>();
+		add<Developer, Publisher>();
+		add<PositiveRatio>();
+		add<DateRange, Genre, PositiveRatio>();
+
+		// storefront and "well reviewed games of a studio" queries
+		add<PriceRange, MinOwners>();
+		add<Genre, PriceRange, MinOwners>();
+		add<Genre, PositiveRatio>();
+		add<Developer, DateRange>();
+		add<Publisher, DateRange>();
+	}
+
+	static const PipelineRegistry& instance() {
+		static const PipelineRegistry registry;
+		return registry;
+	}
+
+	bool is_specialized(uint32_t shape) const {
+		return pipelines.count(shape) == 1;
+	}
+
+	// Row numbers that match every active term of q, in ascending order
+	vector<uint32_t> run(const GameColumns& c, const QuerySpec& q) const {
+		auto iter = pipelines.find(q.shape());
+		if (iter != pipelines.end()) {
+			return iter->second.scan(c, q);
+		}
+		return pipeline::interpret(c, q);
+	}
+
+	// The rows of candidates (ascending) that match every active term of q, e.g. candidates from a RangeIndex
+	vector<uint32_t> run(const GameColumns& c, const QuerySpec& q, const vector<uint32_t>& candidates) const {
+		auto iter = pipelines.find(q.shape());
+		if (iter != pipelines.end()) {
+			return iter->second.filter(c, q, candidates);
+		}
+		return pipeline::interpret(c, q, candidates);
+	}
+};
@@ -0,0 +1,249 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include "MemoryReport.h"
+#include "PredicatePipeline.h"
+#include "Simd.h"
+#include <utility>
+#include <vector>
+
+using std::pair;
+using std::vector;
+
+constexpr size_t RANGE_BUCKETS = 64; // equi-depth target, a value shared by many rows can make a bucket deeper
+
+/*
+* Bucketed range index over one int32 column (price in cents, low end of the owners bucket...)
+*	Rows are sorted by value and cut into equi-depth buckets, a bucket never splits a value. Inside a bucket the
+*	rows are kept in row order next to their values, so a range query takes interior buckets whole, checks values
+*	only in the two boundary buckets, and sets bits of a RowBitmap that comes out in row order.
+*
+*	The buckets double as an equi-depth histogram: estimate() counts the buckets inside the range and
+*	interpolates the boundary ones by value, without touching the rows. GameLibrary uses it to decide whether
+*	a range term is selective enough to drive a query instead of a full scan.
+*
+* Methods
+*	select() - ascending rows with lo <= value <= hi
+*	estimate() / selectivity() - approximate number / fraction of such rows
+*	count() - exact number of such rows, binary search over the bucket bounds and the boundary buckets
+*	update() - follow a renumbering of the column's rows plus added rows without re-sorting the column
+*/
+class RangeIndex {
+	struct Bucket {
+		int32_t lo;			// smallest value in the bucket
+		int32_t hi;			// largest value in the bucket
+		uint32_t begin;		// first entry in rows/values
+		uint32_t end;
+	};
+
+	vector<Bucket> buckets;	// by value
+	vector<uint32_t> rows;	// bucket by bucket, ascending rows inside a bucket
+	vector<int32_t> values;	// value of each entry of rows
+	size_t num_rows = 0;	// rows of the column, the bitmap size
+
+public:
+
+	RangeIndex() {}
+
+	explicit RangeIndex(const vector<int32_t>& column, size_t num_buckets = RANGE_BUCKETS) : num_rows(column.size()) {
+		vector<pair<int32_t, uint32_t>> sorted(column.size());
+		for (size_t r = 0; r < column.size(); ++r) {
+			sorted[r] = { column[r], static_cast<uint32_t>(r) };
+		}
+		std::sort(sorted.begin(), sorted.end());
+
+		size_t depth = std::max<size_t>(1, (sorted.size() + num_buckets - 1) / num_buckets);
+		rows.reserve(sorted.size());
+		values.reserve(sorted.size());
+		size_t begin = 0;
+		while (begin < sorted.size()) {
+			size_t end = std::min(begin + depth, sorted.size());
+			while (end < sorted.size() && sorted[end].first == sorted[end - 1].first) {
+				++end; // keep every row of a value in one bucket
+			}
+			std::sort(sorted.begin() + begin, sorted.begin() + end,
+				[](const pair<int32_t, uint32_t>& a, const pair<int32_t, uint32_t>& b) { return a.second < b.second; });
+
+			Bucket bucket = { INT32_MAX, INT32_MIN, static_cast<uint32_t>(begin), static_cast<uint32_t>(end) };
+			for (size_t i = begin; i < end; ++i) {
+				rows.push_back(sorted[i].second);
+				values.push_back(sorted[i].first);
+				bucket.lo = std::min(bucket.lo, sorted[i].first);
+				bucket.hi = std::max(bucket.hi, sorted[i].first);
+			}
+			buckets.push_back(bucket);
+			begin = end;
+		}
+		buckets.shrink_to_fit();
+	}
+
+	size_t size() const {
+		return num_rows;
+	}
+
+	size_t num_buckets() const {
+		return buckets.size();
+	}
+
+	// Rows with lo <= value <= hi in ascending order
+	vector<uint32_t> select(int32_t lo, int32_t hi) const {
+		RowBitmap bitmap(num_rows);
+		size_t marked = 0;
+		for_overlapping(lo, hi, [&](const Bucket& bucket, bool whole) {
+			for (uint32_t i = bucket.begin; i < bucket.end; ++i) {
+				if (whole || (values[i] >= lo && values[i] <= hi)) {
+					bitmap.set(rows[i]);
+					++marked;
+				}
+			}
+		});
+
+		vector<uint32_t> selection;
+		selection.reserve(marked);
+		for (size_t w = 0; w < bitmap.words.size(); ++w) {
+			for (uint64_t word = bitmap.words[w]; word != 0; word &= word - 1) {
+				selection.push_back(static_cast<uint32_t>(w * 64 + simd::lowest_bit64(word)));
+			}
+		}
+		return selection;
+	}
+
+	// Whole buckets in range count fully, a boundary bucket counts the share of its value range that overlaps
+	double estimate(int32_t lo, int32_t hi) const {
+		double rows_in_range = 0;
+		for_overlapping(lo, hi, [&](const Bucket& bucket, bool whole) {
+			double depth = bucket.end - bucket.begin;
+			if (whole) {
+				rows_in_range += depth;
+				return;
+			}
+			double overlap = double(std::min(hi, bucket.hi)) - std::max(lo, bucket.lo) + 1;
+			rows_in_range += depth * overlap / (double(bucket.hi) - bucket.lo + 1);
+		});
+		return rows_in_range;
+	}
+
+	double selectivity(int32_t lo, int32_t hi) const {
+		return (num_rows == 0) ? 0 : estimate(lo, hi) / num_rows;
+	}
+
+	size_t count(int32_t lo, int32_t hi) const {
+		size_t n = 0;
+		for_overlapping(lo, hi, [&](const Bucket& bucket, bool whole) {
+			if (whole) {
+				n += bucket.end - bucket.begin;
+				return;
+			}
+			for (uint32_t i = bucket.begin; i < bucket.end; ++i) {
+				n += (values[i] >= lo) & (values[i] <= hi);
+			}
+		});
+		return n;
+	}
+
+	/*
+	* Patches the index after the column changed under it (GameLibrary::reload())
+	*	new_row[r] is where old row r went, UINT32_MAX if it's gone. added are the new rows that weren't there
+	*	before (ascending), their values are read from column. Each added row joins the bucket its value falls in
+	*	(the next one up if it falls between two), so buckets stay disjoint and never split a value. Only the
+	*	buckets that lost or gained rows get their bounds recomputed and, if needed, their rows re-sorted. If one bucket ends up more
+	*	than twice as deep as a fresh index would make it, the index is rebuilt from column instead.
+	*/
+	void update(const vector<int32_t>& column, const vector<uint32_t>& new_row, const vector<uint32_t>& added) {
+		vector<pair<size_t, uint32_t>> placed; // (bucket, row) of every added row
+		placed.reserve(added.size());
+		for (const uint32_t& row : added) {
+			int32_t value = column[row];
+			auto bucket = std::lower_bound(buckets.begin(), buckets.end(), value,
+				[](const Bucket& b, int32_t v) { return b.hi < v; });
+			size_t b = buckets.empty() ? 0 : std::min<size_t>(bucket - buckets.begin(), buckets.size() - 1);
+			placed.emplace_back(b, row);
+		}
+		std::sort(placed.begin(), placed.end());
+		if (buckets.empty() && !placed.empty()) {
+			buckets.push_back({ INT32_MAX, INT32_MIN, 0, 0 });
+		}
+
+		num_rows = column.size();
+		size_t max_depth = 2 * std::max<size_t>(1, (num_rows + RANGE_BUCKETS - 1) / RANGE_BUCKETS);
+		vector<uint32_t> next_rows;
+		vector<int32_t> next_values;
+		next_rows.reserve(num_rows);
+		next_values.reserve(num_rows);
+		vector<Bucket> next_buckets;
+		auto next_added = placed.begin();
+		for (size_t b = 0; b < buckets.size(); ++b) {
+			Bucket bucket = buckets[b];
+			uint32_t begin = static_cast<uint32_t>(next_rows.size());
+			bool changed = false;
+			for (uint32_t i = bucket.begin; i < bucket.end; ++i) {
+				if (new_row[rows[i]] == UINT32_MAX) {
+					changed = true;
+					continue;
+				}
+				next_rows.push_back(new_row[rows[i]]);
+				next_values.push_back(values[i]);
+			}
+			for (; next_added != placed.end() && next_added->first == b; ++next_added) {
+				next_rows.push_back(next_added->second);
+				next_values.push_back(column[next_added->second]);
+				changed = true;
+			}
+
+			uint32_t end = static_cast<uint32_t>(next_rows.size());
+			if (end == begin) {
+				continue; // emptied
+			}
+			if (end - begin > max_depth && bucket.lo != bucket.hi) {
+				*this = RangeIndex(column);
+				return;
+			}
+			if (!std::is_sorted(next_rows.begin() + begin, next_rows.end())) {
+				sort_bucket(next_rows, next_values, begin, end);
+			}
+			if (changed) {
+				bucket.lo = *std::min_element(next_values.begin() + begin, next_values.end());
+				bucket.hi = *std::max_element(next_values.begin() + begin, next_values.end());
+			}
+			bucket.begin = begin;
+			bucket.end = end;
+			next_buckets.push_back(bucket);
+		}
+		buckets = std::move(next_buckets);
+		rows = std::move(next_rows);
+		values = std::move(next_values);
+	}
+
+	size_t memory_bytes() const {
+		return memory_usage::of(buckets) + memory_usage::of(rows) + memory_usage::of(values);
+	}
+
+private:
+
+	// Puts entries [begin, end) back in ascending row order
+	static void sort_bucket(vector<uint32_t>& rows, vector<int32_t>& values, uint32_t begin, uint32_t end) {
+		vector<pair<uint32_t, int32_t>> entries;
+		entries.reserve(end - begin);
+		for (uint32_t i = begin; i < end; ++i) {
+			entries.emplace_back(rows[i], values[i]);
+		}
+		std::sort(entries.begin(), entries.end());
+		for (uint32_t i = begin; i < end; ++i) {
+			rows[i] = entries[i - begin].first;
+			values[i] = entries[i - begin].second;
+		}
+	}
+
+	// fn(bucket, whole) for every bucket holding values in [lo, hi], whole = all of its values are
+	template <typename Fn>
+	void for_overlapping(int32_t lo, int32_t hi, Fn&& fn) const {
+		if (lo > hi) {
+			return;
+		}
+		auto first = std::lower_bound(buckets.begin(), buckets.end(), lo,
+			[](const Bucket& bucket, int32_t value) { return bucket.hi < value; });
+		for (auto bucket = first; bucket != buckets.end() && bucket->lo <= hi; ++bucket) {
+			fn(*bucket, bucket->lo >= lo && bucket->hi <= hi);
+		}
+	}
+};
@@ -0,0 +1,309 @@
+#pragma once
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+#include "GameLibrary.h"
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using std::ostream;
+using std::string;
+using std::string_view;
+using std::vector;
+
+constexpr size_t RESULT_BUFFER_BYTES = 1 << 16; // flushed to the stream whenever it fills up
+
+enum class OutputFormat { Text, JsonLines, Binary };
+
+// Columns a ResultWriter can project, all read from GameColumns and the name arena
+enum class ResultColumn : uint8_t { Appid, Name, ReleaseDate, PositiveRatings, NegativeRatings, Owners, Price };
+
+/*
+* Writes search results in batches
+*	Rows are formatted straight into one buffer (to_chars for numbers, names copied out of the name arena) and
+*	the buffer goes to the stream in RESULT_BUFFER_BYTES writes, so a large export costs a handful of write calls
+*	instead of a flush per row. Only the requested columns are formatted.
+*
+*	Text - tab separated columns, one row per line
+*	JsonLines - one {"column": value, ...} object per line
+*	Binary - "GSR1", a byte with the number of columns and one byte per column id, then per row and column:
+*		appid as uint32, names as uint32 length + bytes, owners as two int32 (low, high), everything else one
+*		int32 (yyyymmdd, ratings, price in cents), all in host byte order like the StreamingIngest files
+*
+* Methods
+*	parse_format() / parse_columns() - "text", "jsonl", "binary" / "appid,name,price..." from the command line
+*	write() - append rows of a library, the stream sees them once the buffer fills or on flush()
+*	append() - append rows another writer with the same format and columns already formatted (a shard's)
+*	flush() - hand whatever is buffered to the stream, also done by the destructor
+*/
+class ResultWriter {
+	ostream& out;
+	OutputFormat format;
+	vector<ResultColumn> columns;
+	string buffer;
+	size_t rows_written = 0;
+	size_t bytes_flushed = 0;
+
+public:
+
+	// with_header = false leaves out the binary header, for rows that end up in another writer's output
+	ResultWriter(ostream& out, OutputFormat format, vector<ResultColumn> columns, bool with_header = true)
+		: out(out), format(format), columns(std::move(columns)) {
+		buffer.reserve(RESULT_BUFFER_BYTES + 4096);
+		if (format == OutputFormat::Binary && with_header) {
+			buffer.append("GSR1");
+			buffer.push_back(static_cast<char>(this->columns.size()));
+			for (const ResultColumn& column : this->columns) {
+				buffer.push_back(static_cast<char>(column));
+			}
+		}
+	}
+
+	~ResultWriter() {
+		flush();
+	}
+
+	ResultWriter(const ResultWriter&) = delete;
+	ResultWriter& operator=(const ResultWriter&) = delete;
+
+	static OutputFormat parse_format(const string& name) {
+		if (name == "text") {
+			return OutputFormat::Text;
+		}
+		if (name == "jsonl") {
+			return OutputFormat::JsonLines;
+		}
+		if (name == "binary") {
+			return OutputFormat::Binary;
+		}
+		throw std::invalid_argument("Unknown format \"" + name + "\", expected text, jsonl or binary");
+	}
+
+	static vector<ResultColumn> parse_columns(const string& list) {
+		vector<ResultColumn> result;
+		for (const string& name : Game::split_list(list, ',')) {
+			string key = Game::normalize_entity(name);
+			size_t c = 0;
+			while (c < num_columns() && key != column_name(static_cast<ResultColumn>(c))) {
+				++c;
+			}
+			if (c == num_columns()) {
+				throw std::invalid_argument("Unknown column \"" + name + "\"");
+			}
+			result.push_back(static_cast<ResultColumn>(c));
+		}
+		return result;
+	}
+
+	static constexpr size_t num_columns() {
+		return static_cast<size_t>(ResultColumn::Price) + 1;
+	}
+
+	static const char* column_name(ResultColumn column) {
+		static const char* names[] = { "appid", "name", "release_date", "positive_ratings", "negative_ratings", "owners", "price" };
+		return names[static_cast<size_t>(column)];
+	}
+
+	// rows are GameColumns rows, e.g. from GameLibrary::rows_of() or match_rows()
+	void write(const GameLibrary& lib, const vector<uint32_t>& rows) {
+		const GameColumns& data = lib.get_columns();
+		for (const uint32_t& row : rows) {
+			switch (format) {
+			case OutputFormat::Text:
+				write_text(lib, data, row);
+				break;
+			case OutputFormat::JsonLines:
+				write_json(lib, data, row);
+				break;
+			case OutputFormat::Binary:
+				write_binary(lib, data, row);
+				break;
+			}
+			if (buffer.size() >= RESULT_BUFFER_BYTES) {
+				flush();
+			}
+		}
+		rows_written += rows.size();
+	}
+
+	void append(string_view formatted, size_t num_rows) {
+		buffer.append(formatted);
+		if (buffer.size() >= RESULT_BUFFER_BYTES) {
+			flush();
+		}
+		rows_written += num_rows;
+	}
+
+	void flush() {
+		if (!buffer.empty()) {
+			out.write(buffer.data(), buffer.size());
+			bytes_flushed += buffer.size();
+			buffer.clear();
+		}
+		out.flush();
+	}
+
+	size_t num_rows() const {
+		return rows_written;
+	}
+
+	// Bytes written so far, buffered or not
+	size_t num_bytes() const {
+		return bytes_flushed + buffer.size();
+	}
+
+	OutputFormat get_format() const {
+		return format;
+	}
+
+	const vector<ResultColumn>& get_columns() const {
+		return columns;
+	}
+
+private:
+
+	void write_text(const GameLibrary& lib, const GameColumns& data, uint32_t row) {
+		for (size_t c = 0; c < columns.size(); ++c) {
+			if (c > 0) {
+				buffer.push_back('\t');
+			}
+			write_value(lib, data, row, columns[c], false);
+		}
+		buffer.push_back('\n');
+	}
+
+	void write_json(const GameLibrary& lib, const GameColumns& data, uint32_t row) {
+		buffer.push_back('{');
+		for (size_t c = 0; c < columns.size(); ++c) {
+			buffer.append(c == 0 ? "\"" : ",\"");
+			buffer.append(column_name(columns[c]));
+			buffer.append("\":");
+			write_value(lib, data, row, columns[c], true);
+		}
+		buffer.append("}\n");
+	}
+
+	void write_value(const GameLibrary& lib, const GameColumns& data, uint32_t row, ResultColumn column, bool json) {
+		switch (column) {
+		case ResultColumn::Appid:
+			append_number(data.ids[row]);
+			break;
+		case ResultColumn::Name:
+			if (json) {
+				append_json_string(lib.name_of_row(row));
+			}
+			else {
+				buffer.append(lib.name_of_row(row));
+			}
+			break;
+		case ResultColumn::ReleaseDate:
+			buffer.append(json ? "\"" : "");
+			append_date(data.release_ymd[row]);
+			buffer.append(json ? "\"" : "");
+			break;
+		case ResultColumn::PositiveRatings:
+			append_number(data.positive_ratings[row]);
+			break;
+		case ResultColumn::NegativeRatings:
+			append_number(data.negative_ratings[row]);
+			break;
+		case ResultColumn::Owners:
+			buffer.append(json ? "[" : "");
+			append_number(data.owners_low[row]);
+			buffer.push_back(json ? ',' : '-');
+			append_number(data.owners_high[row]);
+			buffer.append(json ? "]" : "");
+			break;
+		case ResultColumn::Price:
+			append_number(data.price_cents[row] / 100);
+			buffer.push_back('.');
+			buffer.push_back(static_cast<char>('0' + data.price_cents[row] % 100 / 10));
+			buffer.push_back(static_cast<char>('0' + data.price_cents[row] % 10));
+			break;
+		}
+	}
+
+	void write_binary(const GameLibrary& lib, const GameColumns& data, uint32_t row) {
+		for (const ResultColumn& column : columns) {
+			switch (column) {
+			case ResultColumn::Appid:
+				append_raw(static_cast<uint32_t>(data.ids[row]));
+				break;
+			case ResultColumn::Name: {
+				string_view name = lib.name_of_row(row);
+				append_raw(static_cast<uint32_t>(name.size()));
+				buffer.append(name);
+				break;
+			}
+			case ResultColumn::ReleaseDate:
+				append_raw(data.release_ymd[row]);
+				break;
+			case ResultColumn::PositiveRatings:
+				append_raw(data.positive_ratings[row]);
+				break;
+			case ResultColumn::NegativeRatings:
+				append_raw(data.negative_ratings[row]);
+				break;
+			case ResultColumn::Owners:
+				append_raw(data.owners_low[row]);
+				append_raw(data.owners_high[row]);
+				break;
+			case ResultColumn::Price:
+				append_raw(data.price_cents[row]);
+				break;
+			}
+		}
+	}
+
+	template <typename T>
+	void append_number(T value) {
+		char digits[16];
+		std::to_chars_result end = std::to_chars(digits, digits + sizeof(digits), value);
+		buffer.append(digits, end.ptr - digits);
+	}
+
+	template <typename T>
+	void append_raw(T value) {
+		char bytes[sizeof(T)];
+		std::memcpy(bytes, &value, sizeof(T));
+		buffer.append(bytes, sizeof(T));
+	}
+
+	// yyyymmdd -> yyyy-mm-dd
+	void append_date(int32_t ymd) {
+		char date[10];
+		size_t pos = sizeof(date);
+		for (size_t digit = 0; digit < 8; ++digit) {
+			date[--pos] = static_cast<char>('0' + ymd % 10);
+			ymd /= 10;
+			if (digit == 1 || digit == 3) {
+				date[--pos] = '-';
+			}
+		}
+		buffer.append(date, sizeof(date));
+	}
+
+	// Quotes, backslashes and control characters are escaped, UTF-8 passes through unchanged
+	void append_json_string(string_view s) {
+		static const char hex[] = "0123456789abcdef";
+		buffer.push_back('"');
+		for (char c : s) {
+			if (c == '"' || c == '\\') {
+				buffer.push_back('\\');
+				buffer.push_back(c);
+			}
+			else if (static_cast<unsigned char>(c) < 0x20) {
+				buffer.append("\\u00");
+				buffer.push_back(hex[(c >> 4) & 0xF]);
+				buffer.push_back(hex[c & 0xF]);
+			}
+			else {
+				buffer.push_back(c);
+			}
+		}
+		buffer.push_back('"');
+	}
+};
@@ -0,0 +1,341 @@
+#pragma once
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include "Date.h"
+#include "GameDescriptors.h"
+#include "Simd.h"
+#include <string>
+#include "ThreadPool.h"
+#include <vector>
+
+using std::string;
+using std::vector;
+
+/*
+* Typed columns, one entry per game in csv order (row number = index)
+*	Filters that don't have an index (rating ratio, month of release) scan these instead of re-parsing
+*	Game::attributes. Price and owners also have a RangeIndex each, see GameLibrary::match_rows().
+*/
+struct GameColumns {
+	vector<unsigned int> ids;
+	vector<int32_t> release_ymd;	// yyyymmdd, orders the same way Date does
+	vector<int32_t> release_month;
+	vector<int32_t> positive_ratings;
+	vector<int32_t> negative_ratings;
+	vector<int32_t> owners_low;
+	vector<int32_t> owners_high;
+	vector<int32_t> price_cents;
+	vector<uint64_t> content_hashes;	// Game::content_hash(), tells GameLibrary::reload() which rows changed
+	int32_t max_ratings = 0;	// used to check the ratio kernel can't overflow
+	bool ids_sorted = true;		// true for the steam dump, lets row_of() binary search
+
+	size_t size() const {
+		return ids.size();
+	}
+
+	static int32_t to_ymd(const Date& d) {
+		return static_cast<int32_t>(d.get_year() * 10000 + d.get_month() * 100 + d.get_day());
+	}
+
+	static Date to_date(int32_t ymd) {
+		return Date(ymd / 10000, ymd / 100 % 100, ymd % 100);
+	}
+
+	// "9.99" -> 999, throws like stod on anything that isn't a number
+	static int32_t to_cents(const string& price) {
+		return static_cast<int32_t>(std::stod(price) * 100 + 0.5);
+	}
+
+	// Row number of a game, or size() if it isn't in the columns
+	size_t row_of(unsigned int id) const {
+		auto iter = ids_sorted ? std::lower_bound(ids.begin(), ids.end(), id) : std::find(ids.begin(), ids.end(), id);
+		return (iter != ids.end() && *iter == id) ? iter - ids.begin() : size();
+	}
+
+	void append(const Game& g) {
+		const vector<string>& attributes = g.get_attributes();
+		Date release(attributes[2]);
+
+		ids_sorted = ids_sorted && (ids.empty() || ids.back() < g.get_id());
+		ids.push_back(g.get_id());
+		release_ymd.push_back(to_ymd(release));
+		release_month.push_back(static_cast<int32_t>(release.get_month()));
+		positive_ratings.push_back(stoi(attributes[6]));
+		negative_ratings.push_back(stoi(attributes[7]));
+
+		string owners = attributes[8]; // "low-high"
+		owners_low.push_back(stoi(owners.substr(0, owners.find('-'))));
+		owners_high.push_back(stoi(owners.substr(owners.find('-') + 1)));
+
+		price_cents.push_back(to_cents(attributes[9]));
+		content_hashes.push_back(g.content_hash());
+
+		max_ratings = std::max({ max_ratings, positive_ratings.back(), negative_ratings.back() });
+	}
+
+	// Copies row of other to the end, already parsed
+	void append_row(const GameColumns& other, size_t row) {
+		ids_sorted = ids_sorted && (ids.empty() || ids.back() < other.ids[row]);
+		ids.push_back(other.ids[row]);
+		release_ymd.push_back(other.release_ymd[row]);
+		release_month.push_back(other.release_month[row]);
+		positive_ratings.push_back(other.positive_ratings[row]);
+		negative_ratings.push_back(other.negative_ratings[row]);
+		owners_low.push_back(other.owners_low[row]);
+		owners_high.push_back(other.owners_high[row]);
+		price_cents.push_back(other.price_cents[row]);
+		content_hashes.push_back(other.content_hashes[row]);
+		max_ratings = std::max({ max_ratings, positive_ratings.back(), negative_ratings.back() });
+	}
+
+	void reserve(size_t num_rows) {
+		for (vector<int32_t>* column : { &release_ymd, &release_month, &positive_ratings, &negative_ratings, &owners_low, &owners_high, &price_cents }) {
+			column->reserve(num_rows);
+		}
+		ids.reserve(num_rows);
+		content_hashes.reserve(num_rows);
+	}
+
+	void shrink_to_fit() {
+		for (vector<int32_t>* column : { &release_ymd, &release_month, &positive_ratings, &negative_ratings, &owners_low, &owners_high, &price_cents }) {
+			column->shrink_to_fit();
+		}
+		ids.shrink_to_fit();
+		content_hashes.shrink_to_fit();
+	}
+};
+
+enum class Column {
+	ReleaseDate,	// yyyymmdd
+	ReleaseMonth,
+	PositiveRatings,
+	NegativeRatings,
+	OwnersLow,
+	OwnersHigh,
+	PriceCents
+};
+
+struct ScanPredicate {
+	enum class Kind { Between, PositiveRatio } kind;
+	Column column;
+	int32_t lo;
+	int32_t hi;	// for PositiveRatio, lo is the minimum percent of positive reviews
+
+	// lo <= column <= hi
+	static ScanPredicate between(Column c, int32_t lo, int32_t hi) {
+		return { Kind::Between, c, lo, hi };
+	}
+
+	// positive / (positive + negative) >= percent / 100
+	static ScanPredicate positive_ratio(int32_t percent) {
+		return { Kind::PositiveRatio, Column::PositiveRatings, percent, 100 };
+	}
+};
+
+/*
+* Compare-and-mask kernels
+*	select_*() write the row numbers of [begin, end) that pass into out and return how many did.
+*	refine_*() shrink an existing selection vector in place.
+*	The scalar versions are branch free (always write, conditionally advance) so they don't mispredict
+*	on ~50% selective filters.
+*/
+namespace scan_kernels {
+
+	inline size_t select_between_scalar(const int32_t* col, uint32_t begin, uint32_t end, int32_t lo, int32_t hi, uint32_t* out) {
+		size_t n = 0;
+		for (uint32_t i = begin; i < end; ++i) {
+			out[n] = i;
+			n += (col[i] >= lo) & (col[i] <= hi);
+		}
+		return n;
+	}
+
+	inline size_t select_ratio_scalar(const int32_t* pos, const int32_t* neg, uint32_t begin, uint32_t end, int32_t percent, uint32_t* out) {
+		size_t n = 0;
+		for (uint32_t i = begin; i < end; ++i) {
+			out[n] = i;
+			n += int64_t(pos[i]) * (100 - percent) >= int64_t(neg[i]) * percent;
+		}
+		return n;
+	}
+
+	inline size_t refine_between(const int32_t* col, int32_t lo, int32_t hi, uint32_t* sel, size_t count) {
+		size_t n = 0;
+		for (size_t i = 0; i < count; ++i) {
+			uint32_t row = sel[i];
+			sel[n] = row;
+			n += (col[row] >= lo) & (col[row] <= hi);
+		}
+		return n;
+	}
+
+	inline size_t refine_ratio(const int32_t* pos, const int32_t* neg, int32_t percent, uint32_t* sel, size_t count) {
+		size_t n = 0;
+		for (size_t i = 0; i < count; ++i) {
+			uint32_t row = sel[i];
+			sel[n] = row;
+			n += int64_t(pos[row]) * (100 - percent) >= int64_t(neg[row]) * percent;
+		}
+		return n;
+	}
+
+#ifdef GAMESEARCH_X86
+	inline size_t emit_mask(unsigned int mask, uint32_t base, uint32_t* out) {
+		size_t n = 0;
+		while (mask != 0) {
+			out[n++] = base + simd::lowest_bit(mask);
+			mask &= mask - 1;
+		}
+		return n;
+	}
+
+	inline size_t select_between_sse2(const int32_t* col, uint32_t begin, uint32_t end, int32_t lo, int32_t hi, uint32_t* out) {
+		const __m128i vlo = _mm_set1_epi32(lo);
+		const __m128i vhi = _mm_set1_epi32(hi);
+		size_t n = 0;
+		uint32_t i = begin;
+		for (; i + 4 <= end; i += 4) {
+			__m128i x = _mm_loadu_si128(reinterpret_cast<const __m128i*>(col + i));
+			__m128i out_of_range = _mm_or_si128(_mm_cmplt_epi32(x, vlo), _mm_cmpgt_epi32(x, vhi));
+			unsigned int mask = ~_mm_movemask_ps(_mm_castsi128_ps(out_of_range)) & 0xF;
+			n += emit_mask(mask, i, out + n);
+		}
+		return n + select_between_scalar(col, i, end, lo, hi, out + n);
+	}
+
+	TARGET_AVX2 inline size_t select_between_avx2(const int32_t* col, uint32_t begin, uint32_t end, int32_t lo, int32_t hi, uint32_t* out) {
+		const __m256i vlo = _mm256_set1_epi32(lo);
+		const __m256i vhi = _mm256_set1_epi32(hi);
+		size_t n = 0;
+		uint32_t i = begin;
+		for (; i + 8 <= end; i += 8) {
+			__m256i x = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(col + i));
+			__m256i out_of_range = _mm256_or_si256(_mm256_cmpgt_epi32(vlo, x), _mm256_cmpgt_epi32(x, vhi));
+			unsigned int mask = ~_mm256_movemask_ps(_mm256_castsi256_ps(out_of_range)) & 0xFF;
+			n += emit_mask(mask, i, out + n);
+		}
+		return n + select_between_scalar(col, i, end, lo, hi, out + n);
+	}
+
+	// Only valid while max_ratings * 100 fits in an int32, GameColumns::max_ratings is checked before calling
+	TARGET_AVX2 inline size_t select_ratio_avx2(const int32_t* pos, const int32_t* neg, uint32_t begin, uint32_t end, int32_t percent, uint32_t* out) {
+		const __m256i pos_weight = _mm256_set1_epi32(100 - percent);
+		const __m256i neg_weight = _mm256_set1_epi32(percent);
+		size_t n = 0;
+		uint32_t i = begin;
+		for (; i + 8 <= end; i += 8) {
+			__m256i p = _mm256_mullo_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(pos + i)), pos_weight);
+			__m256i q = _mm256_mullo_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(neg + i)), neg_weight);
+			unsigned int mask = ~_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(q, p))) & 0xFF;
+			n += emit_mask(mask, i, out + n);
+		}
+		return n + select_ratio_scalar(pos, neg, i, end, percent, out + n);
+	}
+#endif
+}
+
+/*
+* Runs select_morsel(begin, end, out) over every morsel of [0, num_rows) on the shared thread pool and
+* stitches the surviving row numbers back together in order. select_morsel writes at most end - begin
+* rows to out and returns how many it wrote.
+*/
+template <typename SelectFn>
+vector<uint32_t> parallel_select(size_t num_rows, SelectFn&& select_morsel) {
+	// every morsel writes its survivors to the front of its own slice of buffer
+	vector<uint32_t> buffer(num_rows);
+	vector<size_t> survivors((num_rows + MORSEL_SIZE - 1) / MORSEL_SIZE);
+
+	ThreadPool::shared().parallel_for(0, num_rows, MORSEL_SIZE, [&](size_t lo, size_t hi) {
+		for (size_t m_lo = lo; m_lo < hi; m_lo += MORSEL_SIZE) { // small scans get the whole range in one call
+			size_t m_hi = std::min(m_lo + MORSEL_SIZE, hi);
+			survivors[m_lo / MORSEL_SIZE] = select_morsel(static_cast<uint32_t>(m_lo), static_cast<uint32_t>(m_hi), buffer.data() + m_lo);
+		}
+	});
+
+	vector<uint32_t> selection;
+	for (size_t m = 0; m < survivors.size(); ++m) {
+		auto first = buffer.begin() + m * MORSEL_SIZE;
+		selection.insert(selection.end(), first, first + survivors[m]);
+	}
+	return selection;
+}
+
+/*
+* Full-scan filter over GameColumns
+*	Predicates are ANDed: the first one selects rows with a SIMD kernel, the rest refine the selection vector.
+*	Large catalogs are split into morsels on the shared thread pool.
+*/
+class ScanEngine {
+	const GameColumns& columns;
+	SimdLevel level;
+
+public:
+
+	explicit ScanEngine(const GameColumns& columns, SimdLevel level = simd::level())
+		: columns(columns), level(level) {}
+
+	// Returns the row numbers that pass every predicate, in ascending order
+	vector<uint32_t> filter(const vector<ScanPredicate>& predicates) const {
+		size_t num_rows = columns.size();
+		vector<uint32_t> selection;
+		if (predicates.empty()) {
+			selection.resize(num_rows);
+			for (uint32_t i = 0; i < num_rows; ++i) {
+				selection[i] = i;
+			}
+			return selection;
+		}
+
+		return parallel_select(num_rows, [&](uint32_t begin, uint32_t end, uint32_t* out) {
+			size_t count = select(predicates[0], begin, end, out);
+			for (size_t p = 1; p < predicates.size() && count > 0; ++p) {
+				count = refine(predicates[p], out, count);
+			}
+			return count;
+		});
+	}
+
+	const int32_t* column(Column c) const {
+		switch (c) {
+		case Column::ReleaseDate: return columns.release_ymd.data();
+		case Column::ReleaseMonth: return columns.release_month.data();
+		case Column::PositiveRatings: return columns.positive_ratings.data();
+		case Column::NegativeRatings: return columns.negative_ratings.data();
+		case Column::OwnersLow: return columns.owners_low.data();
+		case Column::OwnersHigh: return columns.owners_high.data();
+		default: return columns.price_cents.data();
+		}
+	}
+
+private:
+
+	size_t select(const ScanPredicate& p, uint32_t begin, uint32_t end, uint32_t* out) const {
+		if (p.kind == ScanPredicate::Kind::PositiveRatio) {
+			const int32_t* pos = columns.positive_ratings.data();
+			const int32_t* neg = columns.negative_ratings.data();
+#ifdef GAMESEARCH_X86
+			if (level == SimdLevel::AVX2 && columns.max_ratings <= INT32_MAX / 100 && p.lo >= 0 && p.lo <= 100) {
+				return scan_kernels::select_ratio_avx2(pos, neg, begin, end, p.lo, out);
+			}
+#endif
+			return scan_kernels::select_ratio_scalar(pos, neg, begin, end, p.lo, out);
+		}
+
+		const int32_t* col = column(p.column);
+		switch (level) {
+#ifdef GAMESEARCH_X86
+		case SimdLevel::AVX2: return scan_kernels::select_between_avx2(col, begin, end, p.lo, p.hi, out);
+		case SimdLevel::SSE2: return scan_kernels::select_between_sse2(col, begin, end, p.lo, p.hi, out);
+#endif
+		default: return scan_kernels::select_between_scalar(col, begin, end, p.lo, p.hi, out);
+		}
+	}
+
+	size_t refine(const ScanPredicate& p, uint32_t* sel, size_t count) const {
+		if (p.kind == ScanPredicate::Kind::PositiveRatio) {
+			return scan_kernels::refine_ratio(columns.positive_ratings.data(), columns.negative_ratings.data(), p.lo, sel, count);
+		}
+		return scan_kernels::refine_between(column(p.column), p.lo, p.hi, sel, count);
+	}
+};
@@ -0,0 +1,687 @@
+#pragma once
+#include <algorithm>
+#include "BooleanQuery.h"
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include "GameLibrary.h"
+#include <iomanip>
+#include <iostream>
+#include <queue>
+#include <random>
+#include <set>
+#include "ShardedLibrary.h"
+#include <streambuf>
+#include <string>
+#include <vector>
+
+using std::ostream;
+using std::set;
+using std::string;
+using std::vector;
+
+constexpr size_t SELFCHECK_QUERIES = 300;		// conjunctive queries per catalog, plus half as many boolean ones
+constexpr size_t SYNTHETIC_GAMES = 20000;
+constexpr size_t SELFCHECK_SHARDS = 3;
+constexpr size_t REPORTED_MISMATCHES = 5;		// per catalog, the rest are only counted
+constexpr size_t RELOAD_PERTURBED_PERCENT = 3;	// of the csv's games dropped, changed or joined by a made-up neighbour
+
+// One randomized conjunctive query, every active term is ANDed. Dates are yyyymmdd, prices are in cents.
+struct CheckQuery {
+	bool has_date = false;
+	int32_t date_lo = 0;
+	int32_t date_hi = 0;
+	string developer;			// empty = term not used
+	string publisher;			// empty = term not used
+	vector<string> genres;		// all of them, empty = term not used
+	bool has_min_positive = false;
+	int32_t min_positive = 0;
+	bool has_ratio = false;
+	int32_t min_percent = 0;
+	bool has_price = false;
+	int32_t price_lo = 0;
+	int32_t price_hi = 0;
+	bool has_min_owners = false;
+	int32_t min_owners = 0;
+
+	GameQuery to_game_query() const {
+		GameQuery query;
+		query.terms.has_date = has_date;
+		query.terms.date_lo = date_lo;
+		query.terms.date_hi = date_hi;
+		query.terms.has_min_positive = has_min_positive;
+		query.terms.min_positive = min_positive;
+		query.terms.has_ratio = has_ratio;
+		query.terms.min_percent = min_percent;
+		query.terms.has_price = has_price;
+		query.terms.price_lo = price_lo;
+		query.terms.price_hi = price_hi;
+		query.terms.has_min_owners = has_min_owners;
+		query.terms.min_owners = min_owners;
+		query.developer = developer;
+		query.publisher = publisher;
+		query.genres = genres;
+		return query;
+	}
+
+	string to_string() const {
+		string out;
+		auto term = [&](const string& s) { out += (out.empty() ? "" : ", ") + s; };
+		if (has_date) {
+			term("date " + std::to_string(date_lo) + ".." + std::to_string(date_hi));
+		}
+		if (!developer.empty()) {
+			term("developer \"" + developer + "\"");
+		}
+		if (!publisher.empty()) {
+			term("publisher \"" + publisher + "\"");
+		}
+		for (const string& genre : genres) {
+			term("genre \"" + genre + "\"");
+		}
+		if (has_min_positive) {
+			term("positive >= " + std::to_string(min_positive));
+		}
+		if (has_ratio) {
+			term("ratio >= " + std::to_string(min_percent) + "%");
+		}
+		if (has_price) {
+			term("price " + std::to_string(price_lo) + ".." + std::to_string(price_hi) + " cents");
+		}
+		if (has_min_owners) {
+			term("owners >= " + std::to_string(min_owners));
+		}
+		return out;
+	}
+};
+
+/*
+* Reference evaluator: every row parsed into plain fields, every query answered by testing each row in turn
+*	Shares nothing with the engines but Date, Game::split_list() and Game::normalize_entity(), which define what a
+*	date and a developer/publisher/tag value are. Slow and obviously right is the point.
+*/
+class ReferenceCatalog {
+	struct Row {
+		appid id;
+		int32_t release;			// yyyymmdd
+		vector<string> developers;	// normalized, "" left out
+		vector<string> publishers;
+		vector<string> genres;
+		int64_t positive;
+		int64_t negative;
+		int64_t owners_low;
+		int64_t price_cents;
+	};
+
+	vector<Row> rows;
+
+public:
+
+	explicit ReferenceCatalog(const vector<Game>& games) {
+		for (const Game& g : games) {
+			const vector<string>& attributes = g.get_attributes();
+			Date release(attributes[2]);
+			Row row;
+			row.id = g.get_id();
+			row.release = static_cast<int32_t>(release.get_year() * 10000 + release.get_month() * 100 + release.get_day());
+			row.developers = values(attributes[3]);
+			row.publishers = values(attributes[4]);
+			row.genres = values(attributes[5]);
+			row.positive = std::stoll(attributes[6]);
+			row.negative = std::stoll(attributes[7]);
+			row.owners_low = std::stoll(attributes[8].substr(0, attributes[8].find('-')));
+			row.price_cents = std::llround(std::stod(attributes[9]) * 100);
+			rows.push_back(std::move(row));
+		}
+	}
+
+	// Sorted appids matching every term of q
+	vector<appid> evaluate(const CheckQuery& q) const {
+		vector<appid> ids;
+		for (const Row& row : rows) {
+			bool keep = true;
+			if (q.has_date) {
+				keep = keep && row.release >= q.date_lo && row.release <= q.date_hi;
+			}
+			if (!q.developer.empty()) {
+				keep = keep && contains(row.developers, q.developer);
+			}
+			if (!q.publisher.empty()) {
+				keep = keep && contains(row.publishers, q.publisher);
+			}
+			for (const string& genre : q.genres) {
+				keep = keep && contains(row.genres, genre);
+			}
+			if (q.has_min_positive) {
+				keep = keep && row.positive >= q.min_positive;
+			}
+			if (q.has_ratio) { // positive / (positive + negative) >= percent / 100, games without reviews pass
+				keep = keep && row.positive * (100 - q.min_percent) >= row.negative * q.min_percent;
+			}
+			if (q.has_price) {
+				keep = keep && row.price_cents >= q.price_lo && row.price_cents <= q.price_hi;
+			}
+			if (q.has_min_owners) {
+				keep = keep && row.owners_low >= q.min_owners;
+			}
+			if (keep) {
+				ids.push_back(row.id);
+			}
+		}
+		std::sort(ids.begin(), ids.end());
+		return ids;
+	}
+
+	// Sorted appids matching a boolean expression tree
+	vector<appid> evaluate(const BooleanQuery::Node& expression) const {
+		vector<appid> ids;
+		for (const Row& row : rows) {
+			if (matches(row, expression)) {
+				ids.push_back(row.id);
+			}
+		}
+		std::sort(ids.begin(), ids.end());
+		return ids;
+	}
+
+	size_t size() const {
+		return rows.size();
+	}
+
+private:
+
+	static vector<string> values(const string& field) {
+		vector<string> out;
+		for (const string& value : Game::split_list(field)) {
+			string key = Game::normalize_entity(value);
+			if (!key.empty()) {
+				out.push_back(key);
+			}
+		}
+		return out;
+	}
+
+	static bool contains(const vector<string>& keys, const string& value) {
+		string key = Game::normalize_entity(value);
+		return !key.empty() && std::find(keys.begin(), keys.end(), key) != keys.end();
+	}
+
+	static bool matches(const Row& row, const BooleanQuery::Node& node) {
+		switch (node.kind) {
+		case BooleanQuery::Node::Kind::Term: {
+			const vector<string>& keys = (node.field == Facet::Genre) ? row.genres
+				: (node.field == Facet::Developer) ? row.developers : row.publishers;
+			return contains(keys, node.value);
+		}
+		case BooleanQuery::Node::Kind::Not:
+			return !matches(row, node.children[0]);
+		case BooleanQuery::Node::Kind::And:
+			for (const BooleanQuery::Node& child : node.children) {
+				if (!matches(row, child)) {
+					return false;
+				}
+			}
+			return true;
+		default:
+			for (const BooleanQuery::Node& child : node.children) {
+				if (matches(row, child)) {
+					return true;
+				}
+			}
+			return false;
+		}
+	}
+};
+
+/*
+* Property-based differential check of every search engine against ReferenceCatalog
+*	Random queries are drawn from the values a catalog actually has (with case/whitespace variants and values
+*	that don't exist mixed in) and answered by every engine: per-term sets merged with merge_n_sets(), the same
+*	sets intersected as sorted lists, the fused/interpreted bitmap scan, the planner (range indexes), the sharded
+*	library (threads, and forked processes where there's fork()) and, for AND/OR/NOT expressions, BooleanQuery.
+*	Results have to match the reference exactly.
+*
+*	The csv catalog is also loaded a second time from a perturbed copy (games dropped, changed and made up) and
+*	brought back with reload(), the planner and BooleanQuery then have to give the same answers on it.
+*
+*	run() checks the csv catalog and a generated one (skewed keywords, spelling variants, duplicate tags, runs
+*	of equal prices) and prints mismatches plus the mean latency of every engine side by side, the reference's
+*	conjunctive and boolean latencies on rows of their own.
+*
+* Methods
+*	run() - check both catalogs, true if every engine agreed with the reference on every query
+*	synthetic_catalog() - num_games generated rows in the csv's column layout
+*	perturbed_catalog() - a copy of games with some dropped, changed or joined by games it doesn't have
+*/
+class SelfCheck {
+	struct EngineStats {
+		string name;
+		size_t queries = 0;
+		size_t mismatches = 0;
+		double seconds = 0;
+	};
+
+	// Swallows cout while engines run, they print their own timings and "No ... found!" lines
+	class QuietOutput {
+		struct NullBuffer : std::streambuf {
+			int overflow(int c) override {
+				return c;
+			}
+		};
+		NullBuffer null;
+		std::streambuf* saved;
+	public:
+		QuietOutput() : saved(cout.rdbuf(&null)) {}
+		~QuietOutput() {
+			cout.rdbuf(saved);
+		}
+	};
+
+	std::mt19937 rng;
+	size_t num_queries;
+	ostream& out;
+
+public:
+
+	SelfCheck(size_t num_queries = SELFCHECK_QUERIES, uint32_t seed = 1, ostream& out = cout)
+		: rng(seed), num_queries(num_queries), out(out) {}
+
+	bool run() {
+		vector<string> header;
+		vector<Game> steam;
+		{
+			QuietOutput quiet;
+			steam = GameLibrary::read_games(DATA_FILE, header);
+		}
+		bool passed = check_catalog(DATA_FILE, steam, header, LibraryMode::Lazy, DATA_FILE);
+		passed = check_catalog("synthetic", synthetic_catalog(SYNTHETIC_GAMES, rng), header, LibraryMode::Compact) && passed;
+		out << (passed ? "All engines match the reference" : "MISMATCHES FOUND") << endl;
+		return passed;
+	}
+
+	// Ids ascend with random gaps; developers/publishers come from small Zipf-ish pools in several spellings
+	static vector<Game> synthetic_catalog(size_t num_games, std::mt19937& rng) {
+		static const vector<string> studios = { "Square Enix", "SQUARE ENIX", " Square  Enix ", "Valve", "valve", "Ubisoft",
+			"Ubisoft Montreal", "Paradox Interactive", "Devolver Digital", "Indie Studio (Ltd.)", "A:B Games", "Solo Dev" };
+		static const vector<string> tags = { "Action", "Indie", "Adventure", "Strategy", "RPG", "Casual", "Simulation",
+			"Early Access", "Free to Play", "Hack and Slash", "Co-op", "Multiplayer", "Puzzle", "Sports", "Racing", "action" };
+		static const vector<string> owners = { "0-20000", "20000-50000", "50000-100000", "100000-200000",
+			"200000-500000", "500000-1000000", "1000000-2000000", "2000000-5000000", "10000000-20000000" };
+		static const vector<string> prices = { "0", "0.0", "0.99", "4.99", "9.99", "9.99", "14.99", "19.99", "59.99", "7.19" };
+
+		auto skewed = [&](size_t n) { // low indexes much more likely
+			std::uniform_real_distribution<double> u(0, 1);
+			double x = u(rng);
+			return std::min(n - 1, static_cast<size_t>(x * x * x * n));
+		};
+		auto list = [&](const vector<string>& pool, size_t max_values) {
+			string field;
+			size_t count = 1 + rng() % max_values;
+			for (size_t i = 0; i < count; ++i) {
+				field += (i == 0 ? "" : ";") + pool[skewed(pool.size())];
+			}
+			return field;
+		};
+
+		vector<Game> games;
+		appid id = 0;
+		for (size_t i = 0; i < num_games; ++i) {
+			id += 1 + rng() % 40;
+			char date[16];
+			snprintf(date, sizeof(date), "%04u-%02u-%02u", static_cast<unsigned int>(1997 + rng() % 23),
+				static_cast<unsigned int>(1 + rng() % 12), static_cast<unsigned int>(1 + rng() % 28));
+			uint32_t positive = (rng() % 4 == 0) ? 0 : static_cast<uint32_t>(skewed(200000));
+			uint32_t negative = (rng() % 4 == 0) ? 0 : static_cast<uint32_t>(skewed(50000));
+			games.emplace_back(vector<string>{ std::to_string(id), "Synthetic Game " + std::to_string(i), date,
+				list(studios, 2), list(studios, 2), list(tags, 5), std::to_string(positive), std::to_string(negative),
+				owners[skewed(owners.size())], prices[rng() % prices.size()] });
+		}
+		return games;
+	}
+
+	// Every game kept, changed (price, ratings, tags or developer), dropped or followed by a made-up game with the next appid
+	static vector<Game> perturbed_catalog(const vector<Game>& games, std::mt19937& rng) {
+		vector<Game> perturbed;
+		for (size_t i = 0; i < games.size(); ++i) {
+			size_t pick = rng() % 100;
+			if (pick >= RELOAD_PERTURBED_PERCENT) {
+				perturbed.push_back(games[i]);
+				continue;
+			}
+			vector<string> attributes = games[i].get_attributes();
+			const vector<string>& other = games[rng() % games.size()].get_attributes();
+			if (pick == 0) {
+				continue; // reload inserts it
+			}
+			if (pick == 1) {
+				attributes[3 + rng() % 3] = other[3 + rng() % 3];
+				attributes[6] = other[6];
+				attributes[9] = other[9];
+				perturbed.emplace_back(std::move(attributes)); // reload updates it
+				continue;
+			}
+			perturbed.push_back(games[i]);
+			appid next = games[i].get_id() + 1;
+			if (i + 1 < games.size() && games[i + 1].get_id() == next) {
+				continue;
+			}
+			attributes = other;
+			attributes[0] = std::to_string(next);
+			attributes[1] = "Made Up Game " + attributes[0];
+			perturbed.emplace_back(std::move(attributes)); // reload deletes it
+		}
+		return perturbed;
+	}
+
+private:
+
+	enum Engine : size_t { Reference, SetMerge, SortedLists, BitmapScan, Planner, Sharded, ShardedProcesses, Reloaded,
+		ReferenceBoolean, Boolean, ReloadedBoolean };
+
+	// csv, if not empty, is the file games were read from, a library of a perturbed copy is reloaded from it
+	bool check_catalog(const string& name, const vector<Game>& games, const vector<string>& header, LibraryMode mode,
+		const string& csv = "") {
+		ReferenceCatalog reference(games);
+		unique_ptr<GameLibrary> lib;
+		unique_ptr<ShardedLibrary> shards;
+		unique_ptr<ShardedLibrary> shard_processes;
+		unique_ptr<GameLibrary> reloaded;
+		{
+			QuietOutput quiet;
+#ifdef GAMESEARCH_FORK
+			// forked before the library's warm-up thread starts
+			shard_processes = std::make_unique<ShardedLibrary>(games, header, SELFCHECK_SHARDS, ShardBy::IdRange, ShardExecution::Processes);
+#endif
+			lib = std::make_unique<GameLibrary>(games, header, mode);
+			shards = std::make_unique<ShardedLibrary>(games, header, SELFCHECK_SHARDS);
+			if (!csv.empty()) {
+				reloaded = std::make_unique<GameLibrary>(perturbed_catalog(games, rng), header, mode);
+				reloaded->reload(csv);
+			}
+		}
+
+		// rows without queries, e.g. reloaded on a catalog that isn't a file, are left out of the report
+		vector<EngineStats> engines = { { "reference" }, { "set merge" }, { "sorted lists" }, { "bitmap scan" },
+			{ "planner" }, { "sharded" }, { "sharded (fork)" }, { "reloaded" }, { "reference (bool)" }, { "boolean query" },
+			{ "reloaded (bool)" } };
+		vector<string> mismatches; // printed with the report, cout is swallowed while the engines run
+		auto check = [&](EngineStats& engine, const vector<appid>& expected, const vector<appid>& got, double seconds,
+			const string& query) {
+			++engine.queries;
+			engine.seconds += seconds;
+			if (got == expected) {
+				return;
+			}
+			++engine.mismatches;
+			if (mismatches.size() < REPORTED_MISMATCHES) {
+				mismatches.push_back(engine.name + " mismatch on [" + query + "]: expected " + std::to_string(expected.size())
+					+ " games, got " + std::to_string(got.size()));
+			}
+		};
+
+		for (size_t i = 0; i < num_queries; ++i) {
+			CheckQuery q = random_query(games);
+			auto start = std::chrono::steady_clock::now();
+			vector<appid> expected = reference.evaluate(q);
+			engines[Reference].seconds += elapsed(start);
+			++engines[Reference].queries;
+
+			QuietOutput quiet;
+			start = std::chrono::steady_clock::now();
+			vector<set<appid>> sets = term_sets(*lib, q);
+			vector<appid> merged = to_vector(GameLibrary::merge_n_sets(sets));
+			check(engines[SetMerge], expected, merged, elapsed(start), q.to_string());
+
+			start = std::chrono::steady_clock::now();
+			priority_queue<SetContainer, vector<SetContainer>, std::greater<SetContainer>> queue;
+			for (const set<appid>& s : term_sets(*lib, q)) {
+				queue.push(SetContainer(s));
+			}
+			vector<appid> intersected = to_vector(GameLibrary::merge_n_sets_intersection(queue));
+			check(engines[SortedLists], expected, intersected, elapsed(start), q.to_string());
+
+			start = std::chrono::steady_clock::now();
+			QuerySpec spec = q.to_game_query().bind(*lib);
+			vector<appid> scanned = to_ids(*lib, PipelineRegistry::instance().run(lib->get_columns(), spec));
+			check(engines[BitmapScan], expected, scanned, elapsed(start), q.to_string());
+
+			start = std::chrono::steady_clock::now();
+			vector<appid> planned = to_ids(*lib, lib->match_rows(q.to_game_query().bind(*lib)));
+			check(engines[Planner], expected, planned, elapsed(start), q.to_string());
+
+			start = std::chrono::steady_clock::now();
+			vector<appid> sharded = to_vector(shards->search(q.to_game_query()));
+			check(engines[Sharded], expected, sharded, elapsed(start), q.to_string());
+
+			if (shard_processes) {
+				start = std::chrono::steady_clock::now();
+				vector<appid> forked = to_vector(shard_processes->search(q.to_game_query()));
+				check(engines[ShardedProcesses], expected, forked, elapsed(start), q.to_string());
+			}
+
+			if (reloaded) {
+				start = std::chrono::steady_clock::now();
+				vector<appid> patched = to_ids(*reloaded, reloaded->match_rows(q.to_game_query().bind(*reloaded)));
+				check(engines[Reloaded], expected, patched, elapsed(start), q.to_string());
+			}
+		}
+
+		for (size_t i = 0; i < num_queries / 2; ++i) {
+			BooleanQuery::Node expression = random_expression(games, 0);
+			string text = render(expression);
+			auto start = std::chrono::steady_clock::now();
+			vector<appid> expected = reference.evaluate(expression);
+			engines[ReferenceBoolean].seconds += elapsed(start);
+			++engines[ReferenceBoolean].queries;
+
+			QuietOutput quiet;
+			start = std::chrono::steady_clock::now();
+			vector<appid> got = to_vector(lib->search_by_query(text));
+			check(engines[Boolean], expected, got, elapsed(start), text);
+
+			if (reloaded) {
+				start = std::chrono::steady_clock::now();
+				vector<appid> patched = to_vector(reloaded->search_by_query(text));
+				check(engines[ReloadedBoolean], expected, patched, elapsed(start), text);
+			}
+		}
+
+		report(name, reference.size(), engines, mismatches);
+		for (const EngineStats& engine : engines) {
+			if (engine.mismatches > 0) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	void report(const string& name, size_t num_games, const vector<EngineStats>& engines, const vector<string>& mismatches) {
+		out << "Catalog " << name << ": " << num_games << " games" << endl;
+		for (const string& mismatch : mismatches) {
+			out << "  " << mismatch << endl;
+		}
+		out << "  " << std::left << std::setw(16) << "engine" << std::right << std::setw(10) << "queries"
+			<< std::setw(12) << "mismatches" << std::setw(16) << "mean latency" << endl;
+		for (const EngineStats& engine : engines) {
+			if (engine.queries == 0) {
+				continue;
+			}
+			double mean_ms = engine.seconds * 1000 / engine.queries;
+			out << "  " << std::left << std::setw(16) << engine.name << std::right << std::setw(10) << engine.queries
+				<< std::setw(12) << (engine.name.compare(0, 9, "reference") == 0 ? string("-") : std::to_string(engine.mismatches))
+				<< std::setw(13) << std::fixed << std::setprecision(3) << mean_ms << " ms" << std::defaultfloat << endl;
+		}
+	}
+
+	// One set per active term, answered by the per-term search methods
+	static vector<set<appid>> term_sets(GameLibrary& lib, const CheckQuery& q) {
+		vector<set<appid>> sets;
+		if (q.has_date) {
+			sets.push_back(lib.search_by_date(ymd_string(q.date_lo), ymd_string(q.date_hi)));
+		}
+		if (!q.developer.empty()) {
+			sets.push_back(lib.search_by_developer(q.developer));
+		}
+		if (!q.publisher.empty()) {
+			sets.push_back(lib.search_by_publisher(q.publisher));
+		}
+		if (!q.genres.empty()) {
+			sets.push_back(lib.search_by_genres(q.genres));
+		}
+		if (q.has_min_positive) {
+			sets.push_back(lib.search_by_positive_reviews(std::to_string(q.min_positive)));
+		}
+		vector<ScanPredicate> predicates;
+		if (q.has_ratio) {
+			predicates.push_back(ScanPredicate::positive_ratio(q.min_percent));
+		}
+		if (q.has_price) {
+			predicates.push_back(ScanPredicate::between(Column::PriceCents, q.price_lo, q.price_hi));
+		}
+		if (q.has_min_owners) {
+			predicates.push_back(ScanPredicate::between(Column::OwnersLow, q.min_owners, INT32_MAX));
+		}
+		if (!predicates.empty()) {
+			sets.push_back(lib.search_by_scan(predicates));
+		}
+		return sets;
+	}
+
+	// A value of column attribute of a random game, sometimes respelled or replaced by one nobody has
+	string random_value(const vector<Game>& games, size_t attribute) {
+		vector<string> values = Game::split_list(games[rng() % games.size()].get_attributes()[attribute]);
+		string value = values[rng() % values.size()];
+		switch (rng() % 8) {
+		case 0:
+			std::transform(value.begin(), value.end(), value.begin(), [](char c) {
+				return (c >= 'a' && c <= 'z') ? static_cast<char>(c - 'a' + 'A') : c;
+			});
+			return value;
+		case 1:
+			return "  " + value + " ";
+		case 2:
+			return "No Such Value " + std::to_string(rng() % 1000);
+		default:
+			return value;
+		}
+	}
+
+	CheckQuery random_query(const vector<Game>& games) {
+		static const int32_t owners[] = { 0, 20000, 50000, 100000, 200000, 500000, 1000000, 2000000, 10000000 };
+		CheckQuery q;
+		while (true) {
+			if (rng() % 3 == 0) {
+				q.has_date = true;
+				q.date_lo = random_ymd(games);
+				q.date_hi = (rng() % 10 == 0) ? q.date_lo : random_ymd(games);
+				if (q.date_lo > q.date_hi && rng() % 4 != 0) { // keep a few reversed ranges, they match nothing
+					std::swap(q.date_lo, q.date_hi);
+				}
+			}
+			if (rng() % 4 == 0) {
+				q.developer = random_value(games, 3);
+			}
+			if (rng() % 5 == 0) {
+				q.publisher = random_value(games, 4);
+			}
+			for (size_t n = (rng() % 3 == 0) ? 1 + rng() % 3 : 0; n > 0; --n) {
+				q.genres.push_back(random_value(games, 5));
+			}
+			if (rng() % 3 == 0) {
+				q.has_min_positive = true;
+				q.min_positive = static_cast<int32_t>((rng() % 2 == 0) ? rng() % 100 : rng() % 20000);
+			}
+			if (rng() % 4 == 0) {
+				q.has_ratio = true;
+				q.min_percent = static_cast<int32_t>(rng() % 101);
+			}
+			if (rng() % 3 == 0) {
+				q.has_price = true;
+				q.price_lo = (rng() % 3 == 0) ? static_cast<int32_t>(rng() % 2000) : 0;
+				q.price_hi = static_cast<int32_t>(rng() % 6000);
+			}
+			if (rng() % 3 == 0) {
+				q.has_min_owners = true;
+				q.min_owners = owners[rng() % (sizeof(owners) / sizeof(owners[0]))];
+			}
+			if (q.has_date || !q.developer.empty() || !q.publisher.empty() || !q.genres.empty() || q.has_min_positive
+				|| q.has_ratio || q.has_price || q.has_min_owners) {
+				return q; // merge_n_sets() needs at least one set
+			}
+		}
+	}
+
+	int32_t random_ymd(const vector<Game>& games) {
+		Date d(games[rng() % games.size()].get_attributes()[2]);
+		return static_cast<int32_t>(d.get_year() * 10000 + d.get_month() * 100 + d.get_day());
+	}
+
+	// Up to three levels of AND/OR/NOT over values the catalog has
+	BooleanQuery::Node random_expression(const vector<Game>& games, size_t depth) {
+		BooleanQuery::Node node;
+		size_t pick = rng() % 10;
+		if (depth >= 3 || pick < 4) {
+			size_t field = rng() % 3;
+			node.field = (field == 0) ? Facet::Genre : (field == 1) ? Facet::Developer : Facet::Publisher;
+			node.value = random_value(games, (field == 0) ? 5 : (field == 1) ? 3 : 4);
+			if (node.value.find('"') != string::npos || Game::normalize_entity(node.value).empty()) {
+				node.value = "Indie"; // quoted values can't contain a quote
+			}
+			return node;
+		}
+		if (pick < 5) {
+			node.kind = BooleanQuery::Node::Kind::Not;
+			node.children.push_back(random_expression(games, depth + 1));
+			return node;
+		}
+		node.kind = (pick < 8) ? BooleanQuery::Node::Kind::And : BooleanQuery::Node::Kind::Or;
+		for (size_t n = 2 + rng() % 2; n > 0; --n) {
+			node.children.push_back(random_expression(games, depth + 1));
+		}
+		return node;
+	}
+
+	// Query text for node, every value quoted and every operator parenthesized, so the text means exactly the tree
+	static string render(const BooleanQuery::Node& node) {
+		switch (node.kind) {
+		case BooleanQuery::Node::Kind::Term: {
+			const char* field = (node.field == Facet::Genre) ? "genre" : (node.field == Facet::Developer) ? "developer" : "publisher";
+			return string(field) + ":\"" + node.value + "\"";
+		}
+		case BooleanQuery::Node::Kind::Not:
+			return "NOT (" + render(node.children[0]) + ")";
+		default: {
+			string text = "(";
+			for (size_t i = 0; i < node.children.size(); ++i) {
+				text += (i == 0) ? "" : (node.kind == BooleanQuery::Node::Kind::And) ? " AND " : " OR ";
+				text += render(node.children[i]);
+			}
+			return text + ")";
+		}
+		}
+	}
+
+	static string ymd_string(int32_t ymd) {
+		char date[16];
+		snprintf(date, sizeof(date), "%04d-%02d-%02d", ymd / 10000, ymd / 100 % 100, ymd % 100);
+		return date;
+	}
+
+	static vector<appid> to_vector(const set<appid>& ids) {
+		return vector<appid>(ids.begin(), ids.end());
+	}
+
+	static vector<appid> to_ids(const GameLibrary& lib, const vector<uint32_t>& rows) {
+		vector<appid> ids;
+		for (const uint32_t& row : rows) {
+			ids.push_back(lib.get_columns().ids[row]);
+		}
+		std::sort(ids.begin(), ids.end());
+		return ids;
+	}
+
+	static double elapsed(std::chrono::steady_clock::time_point start) {
+		std::chrono::duration<double> seconds = std::chrono::steady_clock::now() - start;
+		return seconds.count();
+	}
+};
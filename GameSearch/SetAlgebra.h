@@ -0,0 +1,138 @@
+#pragma once
+#include <algorithm>
+#include <functional>
+#include "GameDescriptors.h"
+#include <iterator>
+#include <queue>
+#include <utility>
+#include <vector>
+
+using std::pair;
+using std::priority_queue;
+using std::vector;
+
+/*
+* Set operations over sorted, duplicate free lists of appids
+*	Everything is a linear merge (or a galloping search when one side is much shorter), so ANDs, ORs and NOTs
+*	over posting lists never go through per element tree lookups. complement() is relative to a universe, the
+*	sorted ids of every game in the library.
+*
+* Methods
+*	intersect() - ids in both lists, or in every list (shortest first)
+*	unite() - ids in either list, or in any list (k-way heap merge)
+*	difference() - ids of a that aren't in b
+*	complement() - ids of universe that aren't in a
+*/
+namespace set_algebra {
+
+	constexpr size_t GALLOP_RATIO = 16; // past this size ratio, binary search the long list instead of walking it
+
+	// First position of [first, last) not less than id, probing 1, 2, 4... ahead before the binary search
+	inline vector<appid>::const_iterator gallop(vector<appid>::const_iterator first, vector<appid>::const_iterator last, appid id) {
+		size_t step = 1;
+		auto lo = first;
+		while (static_cast<size_t>(last - lo) > step && *(lo + step) < id) {
+			lo += step;
+			step *= 2;
+		}
+		return std::lower_bound(lo, std::min(lo + step + 1, last), id);
+	}
+
+	inline vector<appid> intersect(const vector<appid>& a, const vector<appid>& b) {
+		const vector<appid>& shorter = (a.size() <= b.size()) ? a : b;
+		const vector<appid>& longer = (a.size() <= b.size()) ? b : a;
+		vector<appid> result;
+		if (shorter.size() * GALLOP_RATIO < longer.size()) {
+			auto pos = longer.begin();
+			for (const appid& id : shorter) {
+				pos = gallop(pos, longer.end(), id);
+				if (pos == longer.end()) {
+					break;
+				}
+				if (*pos == id) {
+					result.push_back(id);
+				}
+			}
+			return result;
+		}
+		result.reserve(shorter.size());
+		std::set_intersection(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(result));
+		return result;
+	}
+
+	inline vector<appid> intersect(vector<vector<appid>> lists) {
+		if (lists.empty()) {
+			return vector<appid>();
+		}
+		std::sort(lists.begin(), lists.end(), [](const vector<appid>& a, const vector<appid>& b) {
+			return a.size() < b.size();
+		});
+		vector<appid> result = std::move(lists[0]);
+		for (size_t i = 1; i < lists.size() && !result.empty(); ++i) {
+			result = intersect(result, lists[i]);
+		}
+		return result;
+	}
+
+	inline vector<appid> unite(const vector<appid>& a, const vector<appid>& b) {
+		vector<appid> result;
+		result.reserve(a.size() + b.size());
+		std::set_union(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(result));
+		return result;
+	}
+
+	// k-way merge through a min-heap of list heads, O(n log k) however many lists there are
+	inline vector<appid> unite(const vector<vector<appid>>& lists) {
+		if (lists.size() <= 2) {
+			return lists.empty() ? vector<appid>() : (lists.size() == 1) ? lists[0] : unite(lists[0], lists[1]);
+		}
+
+		typedef pair<appid, size_t> Head; // (id, list)
+		priority_queue<Head, vector<Head>, std::greater<Head>> heads;
+		vector<size_t> next(lists.size(), 0);
+		size_t total = 0;
+		for (size_t l = 0; l < lists.size(); ++l) {
+			if (!lists[l].empty()) {
+				heads.emplace(lists[l][0], l);
+				next[l] = 1;
+			}
+			total += lists[l].size();
+		}
+
+		vector<appid> result;
+		result.reserve(total);
+		while (!heads.empty()) {
+			Head head = heads.top();
+			heads.pop();
+			if (result.empty() || result.back() != head.first) {
+				result.push_back(head.first);
+			}
+			size_t l = head.second;
+			if (next[l] < lists[l].size()) {
+				heads.emplace(lists[l][next[l]++], l);
+			}
+		}
+		return result;
+	}
+
+	inline vector<appid> difference(const vector<appid>& a, const vector<appid>& b) {
+		vector<appid> result;
+		if (b.size() > a.size() * GALLOP_RATIO) {
+			auto pos = b.begin();
+			for (const appid& id : a) {
+				pos = gallop(pos, b.end(), id);
+				if (pos == b.end() || *pos != id) {
+					result.push_back(id);
+				}
+			}
+			return result;
+		}
+		result.reserve(a.size());
+		std::set_difference(a.begin(), a.end(), b.begin(), b.end(), std::back_inserter(result));
+		return result;
+	}
+
+	inline vector<appid> complement(const vector<appid>& a, const vector<appid>& universe) {
+		return difference(universe, a);
+	}
+}
@@ -0,0 +1,820 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include "FlatHashMap.h"
+#include "GameLibrary.h"
+#include <memory>
+#include "PredicatePipeline.h"
+#include <queue>
+#include "ResultWriter.h"
+#include "ScanEngine.h"
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include "ThreadPool.h"
+#include <vector>
+
+#if defined(__unix__) || defined(__APPLE__)
+#define GAMESEARCH_FORK
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#endif
+
+using std::pair;
+using std::priority_queue;
+using std::string;
+using std::unique_ptr;
+using std::vector;
+
+/*
+* Keyword form of a QuerySpec
+*	QuerySpec holds row bitmaps, which only mean something inside one library. GameQuery keeps the keywords and
+*	bind() turns them into bitmaps for a given library, so one query can be scattered to every shard (or written
+*	to a shard process).
+*/
+struct GameQuery {
+	QuerySpec terms;			// numeric terms, its keyword bitmaps are ignored
+	vector<string> genres;		// all of them, empty = term not used
+	string developer;			// empty = term not used
+	string publisher;			// empty = term not used
+
+	QuerySpec bind(const GameLibrary& lib) const {
+		QuerySpec spec = terms;
+		spec.has_genre = !genres.empty();
+		spec.genre = RowBitmap();
+		for (size_t i = 0; i < genres.size(); ++i) {
+			RowBitmap rows = lib.genre_rows(genres[i]);
+			if (i == 0) {
+				spec.genre = std::move(rows);
+				continue;
+			}
+			for (size_t w = 0; w < rows.words.size(); ++w) {
+				spec.genre.words[w] &= rows.words[w];
+			}
+		}
+
+		spec.has_developer = !developer.empty();
+		spec.developer = spec.has_developer ? lib.developer_rows(developer) : RowBitmap();
+		spec.has_publisher = !publisher.empty();
+		spec.publisher = spec.has_publisher ? lib.publisher_rows(publisher) : RowBitmap();
+		return spec;
+	}
+};
+
+// One entry of a top-K list, score is the game's value in the ranking column
+struct RankedGame {
+	appid id;
+	int32_t score;
+
+	// "ranks before": higher score first, ties go to the lower appid so every shard layout gives the same order
+	bool operator<(const RankedGame& rhs) const noexcept {
+		return score > rhs.score || (score == rhs.score && id < rhs.id);
+	}
+};
+
+// What the coordinator asks a shard
+struct ShardRequest {
+	enum class Op : uint8_t { Search, TopK, Facets, Name, Write, Quit };
+
+	Op op = Op::Search;
+	GameQuery query;
+	Column order_by = Column::PositiveRatings;	// TopK
+	uint32_t k = 0;								// TopK
+	Facet facet = Facet::Genre;					// Facets
+	appid id = 0;								// Name
+	OutputFormat format = OutputFormat::Text;	// Write
+	vector<ResultColumn> columns;				// Write
+};
+
+// What comes back, only the member of the request's Op is filled
+struct ShardReply {
+	vector<appid> ids;						// Search, ascending
+	vector<RankedGame> ranked;				// TopK, best first
+	vector<pair<string, size_t>> facets;	// Facets, (value, number of matching games)
+	string name;							// Name, empty if the game isn't in this shard
+	string rows;							// Write, the matches formatted by a ResultWriter in appid order
+	vector<uint32_t> row_ends;				// Write, where each row of rows ends, ids holds their appids
+};
+
+namespace sharding {
+
+	// Runs request against one shard's library
+	inline ShardReply execute(GameLibrary& lib, const ShardRequest& request) {
+		ShardReply reply;
+		const GameColumns& columns = lib.get_columns();
+
+		if (request.op == ShardRequest::Op::Name) {
+			if (columns.row_of(request.id) < columns.size()) {
+				reply.name = string(lib.get_name(request.id));
+			}
+			return reply;
+		}
+		if (request.op == ShardRequest::Op::Quit) {
+			return reply;
+		}
+
+		vector<uint32_t> rows = lib.match_rows(request.query.bind(lib));
+		switch (request.op) {
+		case ShardRequest::Op::Search:
+			reply.ids.reserve(rows.size());
+			for (const uint32_t& row : rows) {
+				reply.ids.push_back(columns.ids[row]);
+			}
+			if (!columns.ids_sorted) {
+				std::sort(reply.ids.begin(), reply.ids.end());
+			}
+			break;
+
+		case ShardRequest::Op::TopK: {
+			const int32_t* values = ScanEngine(columns).column(request.order_by);
+			reply.ranked.reserve(rows.size());
+			for (const uint32_t& row : rows) {
+				reply.ranked.push_back({ columns.ids[row], values[row] });
+			}
+			size_t k = std::min<size_t>(request.k, reply.ranked.size());
+			std::partial_sort(reply.ranked.begin(), reply.ranked.begin() + k, reply.ranked.end());
+			reply.ranked.resize(k);
+			break;
+		}
+
+		case ShardRequest::Op::Facets:
+			reply.facets = lib.facet_counts(request.facet, rows);
+			break;
+
+		case ShardRequest::Op::Write: {
+			if (!columns.ids_sorted) {
+				std::sort(rows.begin(), rows.end(), [&](uint32_t a, uint32_t b) { return columns.ids[a] < columns.ids[b]; });
+			}
+			std::ostringstream formatted;
+			ResultWriter writer(formatted, request.format, request.columns, false);
+			reply.ids.reserve(rows.size());
+			reply.row_ends.reserve(rows.size());
+			for (const uint32_t& row : rows) {
+				writer.write(lib, { row });
+				reply.ids.push_back(columns.ids[row]);
+				reply.row_ends.push_back(static_cast<uint32_t>(writer.num_bytes()));
+			}
+			writer.flush();
+			reply.rows = formatted.str();
+			break;
+		}
+
+		default:
+			break;
+		}
+		return reply;
+	}
+
+	/*
+	* Wire format between the coordinator and shard processes
+	*	Every message is a uint64 length followed by the body. Bodies are native byte order PODs and
+	*	length-prefixed strings (both ends are the same binary).
+	*/
+	class MessageWriter {
+		string buffer;
+
+	public:
+
+		template <typename T>
+		void put(const T& value) {
+			buffer.append(reinterpret_cast<const char*>(&value), sizeof(T));
+		}
+
+		void put_string(const string& s) {
+			put(static_cast<uint32_t>(s.size()));
+			buffer += s;
+		}
+
+		const string& data() const {
+			return buffer;
+		}
+	};
+
+	class MessageReader {
+		const string& buffer;
+		size_t pos = 0;
+
+	public:
+
+		explicit MessageReader(const string& buffer) : buffer(buffer) {}
+
+		template <typename T>
+		T get() {
+			if (pos + sizeof(T) > buffer.size()) {
+				throw std::runtime_error("truncated shard message");
+			}
+			T value;
+			memcpy(&value, buffer.data() + pos, sizeof(T));
+			pos += sizeof(T);
+			return value;
+		}
+
+		string get_string() {
+			uint32_t len = get<uint32_t>();
+			if (pos + len > buffer.size()) {
+				throw std::runtime_error("truncated shard message");
+			}
+			string s = buffer.substr(pos, len);
+			pos += len;
+			return s;
+		}
+	};
+
+	inline string encode(const ShardRequest& request) {
+		MessageWriter out;
+		const QuerySpec& t = request.query.terms;
+		out.put(request.op);
+		out.put(request.order_by);
+		out.put(request.k);
+		out.put(request.facet);
+		out.put(request.id);
+		out.put(request.format);
+		out.put(static_cast<uint32_t>(request.columns.size()));
+		for (const ResultColumn& column : request.columns) {
+			out.put(column);
+		}
+
+		out.put(t.has_date);
+		out.put(t.date_lo);
+		out.put(t.date_hi);
+		out.put(t.has_min_positive);
+		out.put(t.min_positive);
+		out.put(t.has_price);
+		out.put(t.price_lo);
+		out.put(t.price_hi);
+		out.put(t.has_min_owners);
+		out.put(t.min_owners);
+		out.put(t.has_ratio);
+		out.put(t.min_percent);
+
+		out.put(static_cast<uint32_t>(request.query.genres.size()));
+		for (const string& genre : request.query.genres) {
+			out.put_string(genre);
+		}
+		out.put_string(request.query.developer);
+		out.put_string(request.query.publisher);
+		return out.data();
+	}
+
+	inline ShardRequest decode_request(const string& message) {
+		MessageReader in(message);
+		ShardRequest request;
+		QuerySpec& t = request.query.terms;
+		request.op = in.get<ShardRequest::Op>();
+		request.order_by = in.get<Column>();
+		request.k = in.get<uint32_t>();
+		request.facet = in.get<Facet>();
+		request.id = in.get<appid>();
+		request.format = in.get<OutputFormat>();
+		request.columns.resize(in.get<uint32_t>());
+		for (ResultColumn& column : request.columns) {
+			column = in.get<ResultColumn>();
+		}
+
+		t.has_date = in.get<bool>();
+		t.date_lo = in.get<int32_t>();
+		t.date_hi = in.get<int32_t>();
+		t.has_min_positive = in.get<bool>();
+		t.min_positive = in.get<int32_t>();
+		t.has_price = in.get<bool>();
+		t.price_lo = in.get<int32_t>();
+		t.price_hi = in.get<int32_t>();
+		t.has_min_owners = in.get<bool>();
+		t.min_owners = in.get<int32_t>();
+		t.has_ratio = in.get<bool>();
+		t.min_percent = in.get<int32_t>();
+
+		request.query.genres.resize(in.get<uint32_t>());
+		for (string& genre : request.query.genres) {
+			genre = in.get_string();
+		}
+		request.query.developer = in.get_string();
+		request.query.publisher = in.get_string();
+		return request;
+	}
+
+	inline string encode(const ShardReply& reply) {
+		MessageWriter out;
+		out.put(static_cast<uint64_t>(reply.ids.size()));
+		for (const appid& id : reply.ids) {
+			out.put(id);
+		}
+		out.put(static_cast<uint64_t>(reply.ranked.size()));
+		for (const RankedGame& game : reply.ranked) {
+			out.put(game);
+		}
+		out.put(static_cast<uint64_t>(reply.facets.size()));
+		for (const auto& facet : reply.facets) {
+			out.put_string(facet.first);
+			out.put(static_cast<uint64_t>(facet.second));
+		}
+		out.put_string(reply.name);
+		out.put_string(reply.rows);
+		out.put(static_cast<uint64_t>(reply.row_ends.size()));
+		for (const uint32_t& end : reply.row_ends) {
+			out.put(end);
+		}
+		return out.data();
+	}
+
+	inline ShardReply decode_reply(const string& message) {
+		MessageReader in(message);
+		ShardReply reply;
+		reply.ids.resize(in.get<uint64_t>());
+		for (appid& id : reply.ids) {
+			id = in.get<appid>();
+		}
+		reply.ranked.resize(in.get<uint64_t>());
+		for (RankedGame& game : reply.ranked) {
+			game = in.get<RankedGame>();
+		}
+		reply.facets.resize(in.get<uint64_t>());
+		for (auto& facet : reply.facets) {
+			facet.first = in.get_string();
+			facet.second = static_cast<size_t>(in.get<uint64_t>());
+		}
+		reply.name = in.get_string();
+		reply.rows = in.get_string();
+		reply.row_ends.resize(in.get<uint64_t>());
+		for (uint32_t& end : reply.row_ends) {
+			end = in.get<uint32_t>();
+		}
+		return reply;
+	}
+
+#ifdef GAMESEARCH_FORK
+	inline bool write_all(int fd, const char* data, size_t size) {
+		while (size > 0) {
+#ifdef MSG_NOSIGNAL
+			ssize_t n = ::send(fd, data, size, MSG_NOSIGNAL); // a dead shard is an error, not a SIGPIPE
+#else
+			ssize_t n = ::write(fd, data, size);
+#endif
+			if (n <= 0) {
+				return false;
+			}
+			data += n;
+			size -= static_cast<size_t>(n);
+		}
+		return true;
+	}
+
+	inline bool read_all(int fd, char* data, size_t size) {
+		while (size > 0) {
+			ssize_t n = ::read(fd, data, size);
+			if (n <= 0) {
+				return false;
+			}
+			data += n;
+			size -= static_cast<size_t>(n);
+		}
+		return true;
+	}
+
+	inline bool send_message(int fd, const string& body) {
+		uint64_t len = body.size();
+		return write_all(fd, reinterpret_cast<const char*>(&len), sizeof(len)) && write_all(fd, body.data(), body.size());
+	}
+
+	inline bool receive_message(int fd, string& body) {
+		uint64_t len;
+		if (!read_all(fd, reinterpret_cast<char*>(&len), sizeof(len))) {
+			return false;
+		}
+		body.resize(len);
+		return len == 0 || read_all(fd, &body[0], len);
+	}
+#endif
+}
+
+/*
+* One partition of the catalog
+*	send() hands a request over and receive() waits for its reply, so a coordinator can start every shard
+*	before it waits on any of them.
+*/
+class Shard {
+public:
+	virtual ~Shard() {}
+	virtual void send(const ShardRequest& request) = 0;
+	virtual ShardReply receive() = 0;
+	virtual size_t size() const = 0;
+};
+
+// Shard living in the coordinator's process, the work happens in receive() on whichever thread calls it
+class LocalShard : public Shard {
+	GameLibrary library;
+	ShardRequest pending;
+
+public:
+
+	LocalShard(vector<Game> rows, vector<string> header, LibraryMode mode)
+		: library(std::move(rows), std::move(header), mode) {}
+
+	void send(const ShardRequest& request) override {
+		pending = request;
+	}
+
+	ShardReply receive() override {
+		return sharding::execute(library, pending);
+	}
+
+	size_t size() const override {
+		return library.get_columns().size();
+	}
+};
+
+#ifdef GAMESEARCH_FORK
+/*
+* Shard in a forked child process, talking over a socketpair
+*	The child builds its GameLibrary from the rows it inherited and answers requests until it gets Quit or the
+*	coordinator's end of the socket closes. inherited_fds are the other shards' sockets, the child closes them so
+*	each child only ever sees EOF from its own coordinator.
+*/
+class ProcessShard : public Shard {
+	pid_t pid = -1;
+	int fd = -1;
+	size_t num_rows;
+
+public:
+
+	ProcessShard(vector<Game> rows, const vector<string>& header, LibraryMode mode, const vector<int>& inherited_fds)
+		: num_rows(rows.size()) {
+		int fds[2];
+		if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+			throw std::runtime_error("couldn't create a socket for a shard process");
+		}
+
+		cout.flush(); // otherwise the child flushes a copy of whatever is buffered
+		pid = fork();
+		if (pid < 0) {
+			close(fds[0]);
+			close(fds[1]);
+			throw std::runtime_error("couldn't fork a shard process");
+		}
+		if (pid == 0) {
+			close(fds[0]);
+			for (int other : inherited_fds) {
+				close(other);
+			}
+			serve(fds[1], std::move(rows), header, mode);
+		}
+
+		close(fds[1]);
+		fd = fds[0];
+	}
+
+	~ProcessShard() {
+		ShardRequest quit;
+		quit.op = ShardRequest::Op::Quit;
+		sharding::send_message(fd, sharding::encode(quit));
+		close(fd);
+		waitpid(pid, nullptr, 0);
+	}
+
+	ProcessShard(const ProcessShard&) = delete;
+	ProcessShard& operator=(const ProcessShard&) = delete;
+
+	void send(const ShardRequest& request) override {
+		if (!sharding::send_message(fd, sharding::encode(request))) {
+			throw std::runtime_error("shard process " + std::to_string(pid) + " isn't answering");
+		}
+	}
+
+	ShardReply receive() override {
+		string message;
+		if (!sharding::receive_message(fd, message)) {
+			throw std::runtime_error("shard process " + std::to_string(pid) + " isn't answering");
+		}
+		return sharding::decode_reply(message);
+	}
+
+	size_t size() const override {
+		return num_rows;
+	}
+
+	int socket() const {
+		return fd;
+	}
+
+private:
+
+	[[noreturn]] static void serve(int fd, vector<Game> rows, const vector<string>& header, LibraryMode mode) {
+		int status = 0;
+		try {
+			GameLibrary library(std::move(rows), header, mode);
+			string message;
+			while (sharding::receive_message(fd, message)) {
+				ShardRequest request = sharding::decode_request(message);
+				if (request.op == ShardRequest::Op::Quit) {
+					break;
+				}
+				if (!sharding::send_message(fd, sharding::encode(sharding::execute(library, request)))) {
+					break;
+				}
+			}
+		}
+		catch (exception& e) {
+			cerr << "shard process failed: " << e.what() << endl;
+			status = 1;
+		}
+		cout.flush();
+		_exit(status); // skip the parent's atexit handlers and static destructors
+	}
+};
+#endif
+
+enum class ShardBy { IdRange, Hash };
+enum class ShardExecution { Threads, Processes };
+
+/*
+* Catalog split into independent GameLibrary shards
+*	IdRange gives every shard a contiguous block of appids (equal number of games each), Hash spreads appids with
+*	a multiplicative hash. Queries are scattered to every shard and the partial results gathered here: id lists
+*	are k-way merged, top-K lists are merged best-first and facet counts are summed per normalized value.
+*
+*	Threads builds and queries the shards as tasks of the shared ThreadPool. Processes forks one child per shard
+*	(POSIX only, falls back to Threads elsewhere); children build their indexes in parallel and keep them in their
+*	own address space. Create process shards before the shared pool is busy, fork only copies the calling thread.
+*/
+class ShardedLibrary {
+	vector<unique_ptr<Shard>> shards;
+	ShardBy partition;
+	vector<appid> range_starts; // IdRange: lowest appid of every shard
+
+public:
+
+	explicit ShardedLibrary(size_t num_shards, ShardBy partition = ShardBy::IdRange,
+		ShardExecution execution = ShardExecution::Threads, LibraryMode mode = LibraryMode::Standard,
+		const string& path = DATA_FILE) : partition(partition) {
+		vector<string> header;
+		vector<Game> rows = GameLibrary::read_games(path, header);
+		build(std::move(rows), header, num_shards, execution, mode);
+	}
+
+	// Shards over rows that are already in memory, e.g. a generated catalog
+	ShardedLibrary(vector<Game> rows, const vector<string>& header, size_t num_shards, ShardBy partition = ShardBy::IdRange,
+		ShardExecution execution = ShardExecution::Threads, LibraryMode mode = LibraryMode::Standard) : partition(partition) {
+		build(std::move(rows), header, num_shards, execution, mode);
+	}
+
+	size_t num_shards() const {
+		return shards.size();
+	}
+
+	size_t shard_size(size_t shard) const {
+		return shards[shard]->size();
+	}
+
+	size_t shard_of(appid id) const {
+		if (partition == ShardBy::Hash) {
+			return hash_shard(id, shards.size());
+		}
+		size_t upper = std::upper_bound(range_starts.begin(), range_starts.end(), id) - range_starts.begin();
+		return (upper == 0) ? 0 : upper - 1;
+	}
+
+	// Every game matching query, same result as GameLibrary::search() over the whole catalog
+	set<appid> search(const GameQuery& query) {
+		auto start = std::chrono::steady_clock::now();
+
+		ShardRequest request;
+		request.op = ShardRequest::Op::Search;
+		request.query = query;
+		vector<ShardReply> replies = scatter(request);
+
+		// k-way merge of the sorted shard results
+		typedef pair<appid, size_t> Head; // (id, shard)
+		priority_queue<Head, vector<Head>, std::greater<Head>> heads;
+		vector<size_t> next(replies.size(), 0);
+		for (size_t s = 0; s < replies.size(); ++s) {
+			if (!replies[s].ids.empty()) {
+				heads.emplace(replies[s].ids[0], s);
+			}
+		}
+		set<appid> result;
+		while (!heads.empty()) {
+			Head head = heads.top();
+			heads.pop();
+			result.insert(result.end(), head.first);
+			const vector<appid>& ids = replies[head.second].ids;
+			if (++next[head.second] < ids.size()) {
+				heads.emplace(ids[next[head.second]], head.second);
+			}
+		}
+
+		auto end = std::chrono::steady_clock::now();
+		std::chrono::duration<double> elapsed_seconds = end - start;
+		cout << "Sharded search took: " << elapsed_seconds.count() << "s" << endl;
+		return result;
+	}
+
+	// The k matching games with the highest order_by value, best first
+	vector<RankedGame> top_k(const GameQuery& query, size_t k, Column order_by = Column::PositiveRatings) {
+		auto start = std::chrono::steady_clock::now();
+
+		ShardRequest request;
+		request.op = ShardRequest::Op::TopK;
+		request.query = query;
+		request.order_by = order_by;
+		request.k = static_cast<uint32_t>(std::min<size_t>(k, UINT32_MAX));
+		vector<ShardReply> replies = scatter(request);
+
+		// every shard list is sorted best first, so only the heads compete
+		typedef pair<RankedGame, size_t> Head; // (game, shard)
+		auto worse = [](const Head& a, const Head& b) { return b.first < a.first; };
+		priority_queue<Head, vector<Head>, decltype(worse)> heads(worse);
+		vector<size_t> next(replies.size(), 0);
+		for (size_t s = 0; s < replies.size(); ++s) {
+			if (!replies[s].ranked.empty()) {
+				heads.emplace(replies[s].ranked[0], s);
+			}
+		}
+		vector<RankedGame> result;
+		while (!heads.empty() && result.size() < k) {
+			Head head = heads.top();
+			heads.pop();
+			result.push_back(head.first);
+			const vector<RankedGame>& ranked = replies[head.second].ranked;
+			if (++next[head.second] < ranked.size()) {
+				heads.emplace(ranked[next[head.second]], head.second);
+			}
+		}
+
+		auto end = std::chrono::steady_clock::now();
+		std::chrono::duration<double> elapsed_seconds = end - start;
+		cout << "Sharded top " << k << " took: " << elapsed_seconds.count() << "s" << endl;
+		return result;
+	}
+
+	// Number of matching games per genre/developer/publisher, most common first, at most limit values
+	vector<pair<string, size_t>> facet_counts(const GameQuery& query, Facet facet, size_t limit = SIZE_MAX) {
+		auto start = std::chrono::steady_clock::now();
+
+		ShardRequest request;
+		request.op = ShardRequest::Op::Facets;
+		request.query = query;
+		request.facet = facet;
+		vector<ShardReply> replies = scatter(request);
+
+		// shards can see different spellings of one value first, so sum by the normalized key
+		FlatHashMap<size_t> slots;
+		vector<pair<string, size_t>> result;
+		string key;
+		for (const ShardReply& reply : replies) {
+			for (const auto& count : reply.facets) {
+				Game::normalize_entity(count.first, key);
+				pair<size_t*, bool> slot = slots.try_emplace(key, result.size());
+				if (slot.second) {
+					result.push_back(count);
+				}
+				else {
+					result[*slot.first].second += count.second;
+				}
+			}
+		}
+		auto more_common = [](const pair<string, size_t>& a, const pair<string, size_t>& b) {
+			return a.second > b.second || (a.second == b.second && a.first < b.first);
+		};
+		if (limit < result.size()) {
+			std::partial_sort(result.begin(), result.begin() + limit, result.end(), more_common);
+			result.resize(limit);
+		}
+		else {
+			std::sort(result.begin(), result.end(), more_common);
+		}
+
+		auto end = std::chrono::steady_clock::now();
+		std::chrono::duration<double> elapsed_seconds = end - start;
+		cout << "Sharded facet count took: " << elapsed_seconds.count() << "s" << endl;
+		return result;
+	}
+
+	/*
+	* Writes every game matching query through writer, in appid order like search()
+	*	Each shard formats its own matches with writer's format and columns, so no name or column travels back one
+	*	game at a time. The formatted rows are merged by appid into writer. Returns the number of rows written.
+	*/
+	size_t write(const GameQuery& query, ResultWriter& writer) {
+		auto start = std::chrono::steady_clock::now();
+
+		ShardRequest request;
+		request.op = ShardRequest::Op::Write;
+		request.query = query;
+		request.format = writer.get_format();
+		request.columns = writer.get_columns();
+		vector<ShardReply> replies = scatter(request);
+
+		typedef pair<appid, size_t> Head; // (id, shard)
+		priority_queue<Head, vector<Head>, std::greater<Head>> heads;
+		vector<size_t> next(replies.size(), 0);
+		for (size_t s = 0; s < replies.size(); ++s) {
+			if (!replies[s].ids.empty()) {
+				heads.emplace(replies[s].ids[0], s);
+			}
+		}
+		size_t num_rows = 0;
+		while (!heads.empty()) {
+			Head head = heads.top();
+			heads.pop();
+			const ShardReply& reply = replies[head.second];
+			size_t i = next[head.second]++;
+			uint32_t begin = (i == 0) ? 0 : reply.row_ends[i - 1];
+			writer.append(string_view(reply.rows).substr(begin, reply.row_ends[i] - begin), 1);
+			++num_rows;
+			if (i + 1 < reply.ids.size()) {
+				heads.emplace(reply.ids[i + 1], head.second);
+			}
+		}
+
+		auto end = std::chrono::steady_clock::now();
+		std::chrono::duration<double> elapsed_seconds = end - start;
+		cout << "Sharded write took: " << elapsed_seconds.count() << "s" << endl;
+		return num_rows;
+	}
+
+	// Asks only the shard that owns id
+	string get_name(appid id) {
+		ShardRequest request;
+		request.op = ShardRequest::Op::Name;
+		request.id = id;
+		Shard& shard = *shards[shard_of(id)];
+		shard.send(request);
+		string name = shard.receive().name;
+		if (name.empty()) {
+			cout << "No games with id: \"" << id << "\" found!" << endl;
+			return "[error]";
+		}
+		return name;
+	}
+
+private:
+
+	void build(vector<Game> rows, const vector<string>& header, size_t num_shards, ShardExecution execution, LibraryMode mode) {
+		auto start = std::chrono::steady_clock::now();
+		vector<vector<Game>> parts = split(std::move(rows), std::max<size_t>(num_shards, 1));
+
+		shards.resize(parts.size());
+#ifdef GAMESEARCH_FORK
+		if (execution == ShardExecution::Processes) {
+			vector<int> sockets;
+			for (size_t i = 0; i < parts.size(); ++i) {
+				auto shard = std::make_unique<ProcessShard>(std::move(parts[i]), header, mode, sockets);
+				sockets.push_back(shard->socket());
+				shards[i] = std::move(shard);
+			}
+		}
+#else
+		execution = ShardExecution::Threads;
+#endif
+		if (execution == ShardExecution::Threads) {
+			ThreadPool::shared().run_each(parts.size(), [&](size_t i) {
+				shards[i] = std::make_unique<LocalShard>(std::move(parts[i]), header, mode);
+			});
+		}
+
+		auto end = std::chrono::steady_clock::now();
+		std::chrono::duration<double> elapsed_seconds = end - start;
+		cout << "Built " << shards.size() << " shards in: " << elapsed_seconds.count() << "s" << endl;
+	}
+
+	static size_t hash_shard(appid id, size_t num_shards) {
+		return static_cast<size_t>((uint64_t(id) * 0x9E3779B97F4A7C15ull) >> 32) % num_shards;
+	}
+
+	vector<vector<Game>> split(vector<Game> rows, size_t num_shards) {
+		vector<vector<Game>> parts;
+		if (partition == ShardBy::Hash) {
+			parts.resize(num_shards);
+			for (Game& g : rows) {
+				parts[hash_shard(g.get_id(), num_shards)].push_back(std::move(g));
+			}
+			return parts;
+		}
+
+		std::stable_sort(rows.begin(), rows.end(), [](const Game& a, const Game& b) { return a.get_id() < b.get_id(); });
+		num_shards = std::max<size_t>(std::min(num_shards, rows.size()), 1);
+		size_t per_shard = (rows.size() + num_shards - 1) / num_shards;
+		for (size_t begin = 0; begin < rows.size() || parts.empty(); begin += per_shard) {
+			size_t end = std::min(begin + per_shard, rows.size());
+			parts.emplace_back(std::make_move_iterator(rows.begin() + begin), std::make_move_iterator(rows.begin() + end));
+			range_starts.push_back(parts.back().empty() ? 0 : parts.back().front().get_id());
+		}
+		return parts;
+	}
+
+	// Sends request to every shard before waiting on any of them, replies are in shard order
+	vector<ShardReply> scatter(const ShardRequest& request) {
+		for (unique_ptr<Shard>& shard : shards) {
+			shard->send(request);
+		}
+		vector<ShardReply> replies(shards.size());
+		ThreadPool::shared().run_each(shards.size(), [&](size_t i) {
+			replies[i] = shards[i]->receive();
+		});
+		return replies;
+	}
+};
@@ -0,0 +1,85 @@
+#pragma once
+#include <cstdint>
+
+// x86-64 always has SSE2, AVX2 is checked at runtime
+#if defined(__x86_64__) || defined(_M_X64)
+#define GAMESEARCH_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+#if defined(GAMESEARCH_X86) && (defined(__GNUC__) || defined(__clang__))
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#else
+#define TARGET_AVX2
+#endif
+
+enum class SimdLevel { Scalar, SSE2, AVX2 };
+
+namespace simd {
+
+	inline int lowest_bit(unsigned int mask) {
+#if defined(GAMESEARCH_X86) && defined(_MSC_VER)
+		unsigned long index;
+		_BitScanForward(&index, mask);
+		return static_cast<int>(index);
+#else
+		return __builtin_ctz(mask);
+#endif
+	}
+
+	inline int lowest_bit64(uint64_t bits) {
+#if defined(GAMESEARCH_X86) && defined(_MSC_VER)
+		unsigned long index;
+		_BitScanForward64(&index, bits);
+		return static_cast<int>(index);
+#else
+		return __builtin_ctzll(bits);
+#endif
+	}
+
+	inline int popcount64(uint64_t bits) {
+#if defined(__GNUC__) || defined(__clang__)
+		return __builtin_popcountll(bits);
+#else
+		// MSVC's __popcnt64 needs the POPCNT instruction, which SSE2 doesn't guarantee
+		bits = bits - ((bits >> 1) & 0x5555555555555555ull);
+		bits = (bits & 0x3333333333333333ull) + ((bits >> 2) & 0x3333333333333333ull);
+		bits = (bits + (bits >> 4)) & 0x0F0F0F0F0F0F0F0Full;
+		return static_cast<int>((bits * 0x0101010101010101ull) >> 56);
+#endif
+	}
+
+	inline SimdLevel detect_level() {
+#if defined(GAMESEARCH_X86) && defined(_MSC_VER)
+		int info[4];
+		__cpuid(info, 0);
+		if (info[0] >= 7) {
+			__cpuidex(info, 1, 0);
+			bool osxsave = (info[2] & (1 << 27)) != 0;
+			bool avx = (info[2] & (1 << 28)) != 0;
+			__cpuidex(info, 7, 0);
+			bool avx2 = (info[1] & (1 << 5)) != 0;
+			if (osxsave && avx && avx2 && (_xgetbv(0) & 0x6) == 0x6) {
+				return SimdLevel::AVX2;
+			}
+		}
+		return SimdLevel::SSE2;
+#elif defined(GAMESEARCH_X86)
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx2")) {
+			return SimdLevel::AVX2;
+		}
+		return __builtin_cpu_supports("sse2") ? SimdLevel::SSE2 : SimdLevel::Scalar;
+#else
+		return SimdLevel::Scalar;
+#endif
+	}
+
+	inline SimdLevel level() {
+		static const SimdLevel detected = detect_level(); // checked once per process
+		return detected;
+	}
+}
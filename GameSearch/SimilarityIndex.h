@@ -0,0 +1,339 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include "CompressedPostings.h"
+#include "PredicatePipeline.h"
+#include "ScanEngine.h"
+#include "Simd.h"
+#include <string>
+#include <utility>
+#include <vector>
+
+using std::pair;
+using std::vector;
+
+constexpr size_t MINHASH_BANDS = 8;
+constexpr size_t MINHASH_ROWS_PER_BAND = 4;	// a pair with Jaccard s shares a bucket with probability 1 - (1 - s^4)^8
+constexpr size_t NUM_MINHASHES = MINHASH_BANDS * MINHASH_ROWS_PER_BAND;
+
+struct SimilarGame {
+	appid id;
+	double similarity; // Jaccard index of the two games' tags + developers + publishers
+};
+
+// |a & b| over bit rows of the same length, the SIMD versions need words to be a multiple of 4
+namespace similarity_kernels {
+
+	inline uint32_t and_popcount_scalar(const uint64_t* a, const uint64_t* b, size_t words) {
+		uint32_t count = 0;
+		for (size_t i = 0; i < words; ++i) {
+			count += simd::popcount64(a[i] & b[i]);
+		}
+		return count;
+	}
+
+#ifdef GAMESEARCH_X86
+	// SSE2 has no byte shuffle, so bytes are counted with the shift-and-mask ladder and summed with psadbw
+	inline uint32_t and_popcount_sse2(const uint64_t* a, const uint64_t* b, size_t words) {
+		const __m128i m1 = _mm_set1_epi8(0x55);
+		const __m128i m2 = _mm_set1_epi8(0x33);
+		const __m128i m4 = _mm_set1_epi8(0x0F);
+		__m128i total = _mm_setzero_si128();
+		for (size_t i = 0; i < words; i += 2) {
+			__m128i x = _mm_and_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i)),
+				_mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i)));
+			x = _mm_sub_epi8(x, _mm_and_si128(_mm_srli_epi16(x, 1), m1));
+			x = _mm_add_epi8(_mm_and_si128(x, m2), _mm_and_si128(_mm_srli_epi16(x, 2), m2));
+			x = _mm_and_si128(_mm_add_epi8(x, _mm_srli_epi16(x, 4)), m4);
+			total = _mm_add_epi64(total, _mm_sad_epu8(x, _mm_setzero_si128()));
+		}
+		return static_cast<uint32_t>(_mm_cvtsi128_si32(total) + _mm_cvtsi128_si32(_mm_srli_si128(total, 8)));
+	}
+
+	// Nibble lookup table through vpshufb, 32 bytes per step
+	TARGET_AVX2 inline uint32_t and_popcount_avx2(const uint64_t* a, const uint64_t* b, size_t words) {
+		const __m256i lookup = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+			0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+		const __m256i low_nibble = _mm256_set1_epi8(0x0F);
+		__m256i total = _mm256_setzero_si256();
+		for (size_t i = 0; i < words; i += 4) {
+			__m256i x = _mm256_and_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i)),
+				_mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i)));
+			__m256i counts = _mm256_add_epi8(_mm256_shuffle_epi8(lookup, _mm256_and_si256(x, low_nibble)),
+				_mm256_shuffle_epi8(lookup, _mm256_and_si256(_mm256_srli_epi16(x, 4), low_nibble)));
+			total = _mm256_add_epi64(total, _mm256_sad_epu8(counts, _mm256_setzero_si256()));
+		}
+		__m128i sum = _mm_add_epi64(_mm256_castsi256_si128(total), _mm256_extracti128_si256(total, 1));
+		return static_cast<uint32_t>(_mm_cvtsi128_si32(sum) + _mm_cvtsi128_si32(_mm_srli_si128(sum, 8)));
+	}
+#endif
+}
+
+/*
+* "Games like X"
+*	Every game is a set of features: its tags, developers and publishers. Tags are a fixed width bitset per row
+*	(intersections are AND + popcount), developers/publishers are a short sorted id list per row. Similarity is
+*	the Jaccard index of the two feature sets.
+*
+*	Candidates come from MinHash LSH: NUM_MINHASHES signatures per game, cut into MINHASH_BANDS bands. Games that
+*	agree on every hash of a band land in the same bucket, so only games sharing a bucket with the query get
+*	scored. If that leaves fewer than k candidates (or a filter allows fewer rows than that) the allowed rows
+*	are scored exhaustively instead.
+*
+*	Features are hashed by their normalized value rather than their canonical id, so the buckets (and answers)
+*	depend only on the catalog, not on the order its keys were first seen in (e.g. after GameLibrary::reload()).
+*/
+class SimilarityIndex {
+	const GameColumns& columns;
+	SimdLevel level;
+
+	size_t tag_words = 0;				// per row, a multiple of 4 so the SIMD kernels only see whole vectors
+	vector<uint64_t> tag_bits;			// row-major, tag_words per row
+	vector<uint16_t> tag_counts;
+
+	vector<uint32_t> entity_offsets;	// row r owns entity_ids[entity_offsets[r], entity_offsets[r + 1])
+	vector<uint32_t> entity_ids;		// developer ids, then publisher ids + number of developers, sorted per row
+
+	vector<uint64_t> tag_features;		// MinHash feature of each tag id
+	vector<uint64_t> entity_features;	// same for each entity id
+
+	vector<vector<pair<uint64_t, uint32_t>>> bands; // per band: (bucket, row) sorted by bucket
+
+public:
+
+	SimilarityIndex(const GameColumns& columns, const PostingIndex& genres, const PostingIndex& developers,
+		const PostingIndex& publishers, SimdLevel level = simd::level()) : columns(columns), level(level) {
+		size_t num_rows = columns.size();
+		tag_words = std::max<size_t>((genres.size() + 255) / 256 * 4, 4);
+		tag_bits.assign(num_rows * tag_words, 0);
+		tag_counts.assign(num_rows, 0);
+
+		for (uint32_t tag = 0; tag < genres.size(); ++tag) {
+			genres.postings(tag).for_each([&](appid id) {
+				size_t row = columns.row_of(id);
+				if (row < num_rows) {
+					tag_bits[row * tag_words + tag / 64] |= uint64_t(1) << (tag % 64);
+					++tag_counts[row];
+				}
+			});
+		}
+
+		vector<vector<uint32_t>> entities(num_rows);
+		add_entities(entities, developers, 0);
+		add_entities(entities, publishers, static_cast<uint32_t>(developers.size()));
+		entity_offsets.reserve(num_rows + 1);
+		entity_offsets.push_back(0);
+		for (vector<uint32_t>& row : entities) {
+			std::sort(row.begin(), row.end());
+			row.erase(std::unique(row.begin(), row.end()), row.end());
+			entity_ids.insert(entity_ids.end(), row.begin(), row.end());
+			entity_offsets.push_back(static_cast<uint32_t>(entity_ids.size()));
+		}
+
+		add_features(tag_features, genres, 1);
+		add_features(entity_features, developers, 2);
+		add_features(entity_features, publishers, 3);
+
+		bands.resize(MINHASH_BANDS);
+		uint32_t signature[NUM_MINHASHES];
+		for (uint32_t row = 0; row < num_rows; ++row) {
+			if (!minhash(row, signature)) {
+				continue; // no features, nothing can be similar to it
+			}
+			for (size_t b = 0; b < MINHASH_BANDS; ++b) {
+				bands[b].emplace_back(band_key(signature, b), row);
+			}
+		}
+		for (vector<pair<uint64_t, uint32_t>>& band : bands) {
+			std::sort(band.begin(), band.end());
+			band.shrink_to_fit();
+		}
+	}
+
+	size_t size() const {
+		return tag_counts.size();
+	}
+
+	double jaccard(uint32_t a, uint32_t b) const {
+		uint32_t shared = shared_tags(a, b) + shared_entities(a, b);
+		uint32_t total = num_features(a) + num_features(b) - shared;
+		return (total == 0) ? 0.0 : double(shared) / total;
+	}
+
+	// Rows sharing at least one LSH bucket with row, ascending, row itself excluded
+	vector<uint32_t> candidates(uint32_t row) const {
+		vector<uint32_t> result;
+		uint32_t signature[NUM_MINHASHES];
+		if (!minhash(row, signature)) {
+			return result;
+		}
+		for (size_t b = 0; b < MINHASH_BANDS; ++b) {
+			uint64_t key = band_key(signature, b);
+			auto first = std::lower_bound(bands[b].begin(), bands[b].end(), pair<uint64_t, uint32_t>(key, 0));
+			for (auto iter = first; iter != bands[b].end() && iter->first == key; ++iter) {
+				if (iter->second != row) {
+					result.push_back(iter->second);
+				}
+			}
+		}
+		std::sort(result.begin(), result.end());
+		result.erase(std::unique(result.begin(), result.end()), result.end());
+		return result;
+	}
+
+	/*
+	* The k most similar games to row, most similar first (ties go to the lower appid)
+	*	allowed restricts the answer to the rows of a filter, num_allowed is its number of set bits.
+	*/
+	vector<SimilarGame> top_k(uint32_t row, size_t k, const RowBitmap* allowed = nullptr, size_t num_allowed = 0) const {
+		vector<SimilarGame> result;
+		if (row >= size() || k == 0) {
+			return result;
+		}
+
+		vector<uint32_t> rows = candidates(row);
+		if (allowed != nullptr) {
+			rows.erase(std::remove_if(rows.begin(), rows.end(), [&](uint32_t r) { return !allowed->test(r); }), rows.end());
+		}
+		bool exhaustive = rows.size() < k || (allowed != nullptr && num_allowed <= rows.size());
+		if (exhaustive) {
+			rows.clear();
+			for (uint32_t r = 0; r < size(); ++r) {
+				if (r != row && (allowed == nullptr || allowed->test(r))) {
+					rows.push_back(r);
+				}
+			}
+		}
+
+		for (const uint32_t& r : rows) {
+			double similarity = jaccard(row, r);
+			if (similarity > 0) {
+				result.push_back({ columns.ids[r], similarity });
+			}
+		}
+		auto more_similar = [](const SimilarGame& a, const SimilarGame& b) {
+			return a.similarity > b.similarity || (a.similarity == b.similarity && a.id < b.id);
+		};
+		k = std::min(k, result.size());
+		std::partial_sort(result.begin(), result.begin() + k, result.end(), more_similar);
+		result.resize(k);
+		return result;
+	}
+
+	size_t memory_bytes() const {
+		size_t bytes = memory_usage::of(tag_bits) + memory_usage::of(tag_counts) + memory_usage::of(entity_offsets)
+			+ memory_usage::of(entity_ids) + memory_usage::of(tag_features) + memory_usage::of(entity_features)
+			+ memory_usage::of(bands);
+		for (const vector<pair<uint64_t, uint32_t>>& band : bands) {
+			bytes += memory_usage::of(band);
+		}
+		return bytes;
+	}
+
+private:
+
+	void add_entities(vector<vector<uint32_t>>& entities, const PostingIndex& index, uint32_t first_id) const {
+		for (uint32_t key = 0; key < index.size(); ++key) {
+			index.postings(key).for_each([&](appid id) {
+				size_t row = columns.row_of(id);
+				if (row < entities.size()) {
+					entities[row].push_back(first_id + key);
+				}
+			});
+		}
+	}
+
+	// One feature per key of index, from its normalized value and the kind of key (tag, developer, publisher)
+	static void add_features(vector<uint64_t>& features, const PostingIndex& index, uint64_t kind) {
+		string key;
+		for (const string& value : index.get_keys()) {
+			Game::normalize_entity(value, key);
+			features.push_back(mix(std::hash<string>()(key) ^ (kind << 56)));
+		}
+	}
+
+	uint32_t num_features(uint32_t row) const {
+		return tag_counts[row] + (entity_offsets[row + 1] - entity_offsets[row]);
+	}
+
+	uint32_t shared_tags(uint32_t a, uint32_t b) const {
+		const uint64_t* x = &tag_bits[a * tag_words];
+		const uint64_t* y = &tag_bits[b * tag_words];
+#ifdef GAMESEARCH_X86
+		if (level == SimdLevel::AVX2) {
+			return similarity_kernels::and_popcount_avx2(x, y, tag_words);
+		}
+		if (level == SimdLevel::SSE2) {
+			return similarity_kernels::and_popcount_sse2(x, y, tag_words);
+		}
+#endif
+		return similarity_kernels::and_popcount_scalar(x, y, tag_words);
+	}
+
+	// developers/publishers rarely number more than two per game, a merge beats anything clever
+	uint32_t shared_entities(uint32_t a, uint32_t b) const {
+		const uint32_t* x = entity_ids.data() + entity_offsets[a];
+		const uint32_t* x_end = entity_ids.data() + entity_offsets[a + 1];
+		const uint32_t* y = entity_ids.data() + entity_offsets[b];
+		const uint32_t* y_end = entity_ids.data() + entity_offsets[b + 1];
+		uint32_t shared = 0;
+		while (x != x_end && y != y_end) {
+			if (*x < *y) {
+				++x;
+			}
+			else if (*y < *x) {
+				++y;
+			}
+			else {
+				++shared;
+				++x;
+				++y;
+			}
+		}
+		return shared;
+	}
+
+	static uint64_t mix(uint64_t x) {
+		x ^= x >> 33;
+		x *= 0xFF51AFD7ED558CCDull;
+		x ^= x >> 33;
+		x *= 0xC4CEB9FE1A85EC53ull;
+		x ^= x >> 33;
+		return x;
+	}
+
+	// Fills signature with the minimum of every hash function over the row's features, false if it has none
+	bool minhash(uint32_t row, uint32_t* signature) const {
+		if (num_features(row) == 0) {
+			return false;
+		}
+		std::fill(signature, signature + NUM_MINHASHES, UINT32_MAX);
+		auto add_feature = [&](uint64_t feature) {
+			uint64_t base = mix(feature + 1);
+			for (size_t h = 0; h < NUM_MINHASHES; ++h) {
+				uint32_t value = static_cast<uint32_t>(mix(base + h * 0x9E3779B97F4A7C15ull));
+				signature[h] = std::min(signature[h], value);
+			}
+		};
+
+		const uint64_t* bits = &tag_bits[row * tag_words];
+		for (size_t w = 0; w < tag_words; ++w) {
+			for (uint64_t word = bits[w]; word != 0; word &= word - 1) {
+				add_feature(tag_features[w * 64 + simd::popcount64((word & (0 - word)) - 1)]);
+			}
+		}
+		for (uint32_t e = entity_offsets[row]; e < entity_offsets[row + 1]; ++e) {
+			add_feature(entity_features[entity_ids[e]]);
+		}
+		return true;
+	}
+
+	static uint64_t band_key(const uint32_t* signature, size_t band) {
+		uint64_t key = band;
+		for (size_t i = 0; i < MINHASH_ROWS_PER_BAND; ++i) {
+			key = mix(key ^ (uint64_t(signature[band * MINHASH_ROWS_PER_BAND + i]) << 8));
+		}
+		return key;
+	}
+};
@@ -0,0 +1,604 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include "CsvTokenizer.h"
+#include "Date.h"
+#include <filesystem>
+#include "FlatHashMap.h"
+#include <fstream>
+#include "GameDescriptors.h"
+#include <iostream>
+#include <map>
+#include <queue>
+#include "ScanEngine.h"
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace fs = std::filesystem;
+using std::ifstream;
+using std::map;
+using std::ofstream;
+using std::pair;
+using std::priority_queue;
+using std::string;
+using std::vector;
+
+constexpr size_t DEFAULT_CHUNK_ROWS = 50000;	// rows parsed and indexed in memory before spilling a segment
+constexpr size_t MAX_MERGE_FAN_IN = 64;			// segments merged at once, keeps open files and buffers bounded
+constexpr size_t POSTING_BLOCK = 4096;			// appids buffered per posting list while merging, however long the list is
+constexpr const char* INGEST_MARKER = ".gamesearch_ingest";	// marks a directory StreamingIngest may clear
+
+// Raw binary helpers for the segment files, native byte order (segments never leave the machine)
+namespace disk_io {
+	template <typename T>
+	void write(ofstream& out, const T& value) {
+		out.write(reinterpret_cast<const char*>(&value), sizeof(T));
+	}
+
+	template <typename T>
+	bool read(ifstream& in, T& value) {
+		return static_cast<bool>(in.read(reinterpret_cast<char*>(&value), sizeof(T)));
+	}
+
+	inline void write_string(ofstream& out, const string& s) {
+		write(out, static_cast<uint32_t>(s.size()));
+		out.write(s.data(), s.size());
+	}
+
+	inline bool read_string(ifstream& in, string& s) {
+		uint32_t len;
+		if (!read(in, len)) {
+			return false;
+		}
+		s.resize(len);
+		return static_cast<bool>(in.read(&s[0], len));
+	}
+
+	template <typename T>
+	void append_column(const fs::path& file, const vector<T>& values) {
+		ofstream out(file, std::ios::binary | std::ios::app);
+		out.write(reinterpret_cast<const char*>(values.data()), values.size() * sizeof(T));
+	}
+}
+
+// (key, appid) record of a sorted run, used for the date, review and appid -> row runs
+struct KeyedRecord {
+	static constexpr size_t DISK_BYTES = sizeof(int64_t) + sizeof(uint32_t); // field by field, no struct padding on disk
+
+	int64_t key;
+	uint32_t id;
+
+	void write(ofstream& out) const {
+		disk_io::write(out, key);
+		disk_io::write(out, id);
+	}
+
+	bool read(ifstream& in) {
+		return disk_io::read(in, key) && disk_io::read(in, id);
+	}
+
+	bool operator<(const KeyedRecord& rhs) const noexcept {
+		return key < rhs.key || (key == rhs.key && id < rhs.id);
+	}
+	bool operator>(const KeyedRecord& rhs) const noexcept {
+		return rhs < *this;
+	}
+};
+
+/*
+* Streaming csv ingest
+*	Reads the csv chunk_rows lines at a time. Each chunk appends its typed columns and names to the output
+*	directory and spills one sorted segment per index (posting lists for developers/publishers/genres, sorted
+*	runs for release date and positive reviews). finish() then merges the segments like an external sort.
+*	Peak memory is one chunk plus one POSTING_BLOCK of appids per segment being merged, no matter how big the csv
+*	is or how many games share a key.
+*
+*	The output directory has to be empty, missing, or the output of an earlier ingest (it holds INGEST_MARKER).
+*	Only the files listed below are replaced, anything else in the directory is left alone.
+*
+* Output directory
+*	columns/<column>.bin	- one int32 per row, same layout as GameColumns
+*	names.bin				- [len][bytes] per row, columns/name_offsets.bin has the uint64 offset of each row
+*	<index>.dict/.post		- sorted normalized keys with (offset, count) into the posting file of appids
+*	<run>.run				- KeyedRecords sorted by key, KeyedRecord::DISK_BYTES each
+*/
+class StreamingIngest {
+	string csv_path;
+	fs::path out_dir;
+	size_t chunk_rows;
+
+	size_t num_rows = 0;
+	size_t num_segments = 0;
+	uint64_t names_offset = 0;
+
+public:
+
+	StreamingIngest(const string& csv_path, const string& out_dir, size_t chunk_rows = DEFAULT_CHUNK_ROWS)
+		: csv_path(csv_path), out_dir(out_dir), chunk_rows(std::max<size_t>(chunk_rows, 1)) {}
+
+	// Returns the number of rows ingested, throws runtime_error if out_dir isn't safe to write into
+	size_t run() {
+		auto start = std::chrono::steady_clock::now();
+		ifstream csv(csv_path, std::ios::binary);
+		if (!csv) {
+			cout << "Could not open " << csv_path << endl;
+			return 0;
+		}
+
+		clear_output();
+		fs::create_directories(out_dir / "columns");
+		fs::create_directories(out_dir / "segments");
+		ofstream(out_dir / INGEST_MARKER);
+
+		CsvReader reader(csv);
+		vector<string> fields;
+		reader.next_record(fields); // header
+		size_t num_columns = fields.size();
+
+		cout << "Streaming csv file into " << out_dir.string();
+		vector<Game> chunk;
+		while (reader.next_record(fields)) {
+			if (fields.size() < num_columns) { // blank or truncated line
+				continue;
+			}
+			chunk.push_back(Game(std::move(fields)));
+			if (chunk.size() == chunk_rows) {
+				spill_chunk(chunk);
+				chunk.clear();
+				cout << ".";
+			}
+		}
+		if (!chunk.empty()) {
+			spill_chunk(chunk);
+		}
+		cout << "Finished reading " << num_rows << " rows into " << num_segments << " segments" << endl;
+
+		finish();
+
+		auto end = std::chrono::steady_clock::now();
+		std::chrono::duration<double> elapsed_seconds = end - start;
+		cout << "  Took: " << elapsed_seconds.count() << "s to ingest data" << endl;
+		return num_rows;
+	}
+
+private:
+
+	static const vector<string>& posting_indexes() {
+		static const vector<string> names = { "developers", "publishers", "genres" };
+		return names;
+	}
+
+	static const vector<string>& sorted_runs() {
+		static const vector<string> names = { "release_dates", "positive_reviews", "appid_rows" };
+		return names;
+	}
+
+	// Removes what an earlier ingest wrote, refuses a directory that has other files and no INGEST_MARKER
+	void clear_output() const {
+		if (!fs::exists(out_dir)) {
+			return;
+		}
+		if (!fs::is_directory(out_dir)) {
+			throw std::runtime_error(out_dir.string() + " is not a directory");
+		}
+		if (!fs::is_empty(out_dir) && !fs::exists(out_dir / INGEST_MARKER)) {
+			throw std::runtime_error(out_dir.string() + " is not empty and wasn't written by an ingest, refusing to overwrite it");
+		}
+
+		fs::remove_all(out_dir / "columns");
+		fs::remove_all(out_dir / "segments");
+		fs::remove(out_dir / "names.bin");
+		for (const string& index : posting_indexes()) {
+			fs::remove(out_dir / (index + ".dict"));
+			fs::remove(out_dir / (index + ".post"));
+		}
+		for (const string& run : sorted_runs()) {
+			fs::remove(out_dir / (run + ".run"));
+		}
+	}
+
+	fs::path segment_path(const string& index, size_t segment) const {
+		return out_dir / "segments" / (index + "_" + std::to_string(segment) + ".seg");
+	}
+
+	// Same keys as GameLibrary's PostingIndexes: normalized, empty values dropped
+	static void add_postings(map<string, vector<appid>>& postings, const vector<string>& values, appid id) {
+		for (const string& value : values) {
+			string key = Game::normalize_entity(value);
+			if (!key.empty()) {
+				postings[key].push_back(id);
+			}
+		}
+	}
+
+	void spill_chunk(const vector<Game>& chunk) {
+		GameColumns columns;
+		vector<map<string, vector<appid>>> postings(posting_indexes().size());
+		vector<vector<KeyedRecord>> runs(sorted_runs().size());
+		vector<uint64_t> name_offsets;
+
+		ofstream names(out_dir / "names.bin", std::ios::binary | std::ios::app);
+		for (const Game& g : chunk) {
+			columns.append(g);
+			const vector<string>& attributes = g.get_attributes();
+
+			add_postings(postings[0], Game::split_list(attributes[3]), g.get_id());
+			add_postings(postings[1], Game::split_list(attributes[4]), g.get_id());
+			add_postings(postings[2], Game::process_tags(attributes[5]), g.get_id());
+
+			runs[0].push_back({ columns.release_ymd.back(), g.get_id() });
+			runs[1].push_back({ columns.positive_ratings.back(), g.get_id() });
+			runs[2].push_back({ g.get_id(), static_cast<uint32_t>(num_rows + columns.size() - 1) });
+
+			name_offsets.push_back(names_offset);
+			disk_io::write_string(names, g.get_name());
+			names_offset += sizeof(uint32_t) + g.get_name().size();
+		}
+
+		disk_io::append_column(out_dir / "columns" / "ids.bin", columns.ids);
+		disk_io::append_column(out_dir / "columns" / "release_ymd.bin", columns.release_ymd);
+		disk_io::append_column(out_dir / "columns" / "release_month.bin", columns.release_month);
+		disk_io::append_column(out_dir / "columns" / "positive_ratings.bin", columns.positive_ratings);
+		disk_io::append_column(out_dir / "columns" / "negative_ratings.bin", columns.negative_ratings);
+		disk_io::append_column(out_dir / "columns" / "owners_low.bin", columns.owners_low);
+		disk_io::append_column(out_dir / "columns" / "owners_high.bin", columns.owners_high);
+		disk_io::append_column(out_dir / "columns" / "price_cents.bin", columns.price_cents);
+		disk_io::append_column(out_dir / "columns" / "name_offsets.bin", name_offsets);
+
+		for (size_t p = 0; p < postings.size(); ++p) {
+			ofstream seg(segment_path(posting_indexes()[p], num_segments), std::ios::binary);
+			for (auto& entry : postings[p]) { // map keeps the keys sorted
+				std::sort(entry.second.begin(), entry.second.end());
+				write_posting(seg, entry.first, entry.second);
+			}
+		}
+
+		for (size_t r = 0; r < runs.size(); ++r) {
+			std::sort(runs[r].begin(), runs[r].end());
+			ofstream seg(segment_path(sorted_runs()[r], num_segments), std::ios::binary);
+			for (const KeyedRecord& rec : runs[r]) {
+				rec.write(seg);
+			}
+		}
+
+		num_rows += chunk.size();
+		++num_segments;
+	}
+
+	static void write_posting(ofstream& out, const string& key, const vector<appid>& ids) {
+		disk_io::write_string(out, key);
+		disk_io::write(out, static_cast<uint32_t>(ids.size()));
+		out.write(reinterpret_cast<const char*>(ids.data()), ids.size() * sizeof(appid));
+	}
+
+	// Walks the posting lists of a segment, each list read POSTING_BLOCK appids at a time
+	class PostingReader {
+		ifstream in;
+		uint32_t remaining = 0;		// appids of the current list not read from the file yet
+		vector<appid> block;
+		size_t pos = 0;
+
+	public:
+		string key;
+		uint32_t count = 0;
+
+		explicit PostingReader(const fs::path& file) : in(file, std::ios::binary) {}
+
+		// Moves to the next list, the current one has to be read to its end first
+		bool next_list() {
+			block.clear();
+			pos = 0;
+			if (!disk_io::read_string(in, key) || !disk_io::read(in, count)) {
+				return false;
+			}
+			remaining = count;
+			return true;
+		}
+
+		bool next_id(appid& id) {
+			if (pos == block.size()) {
+				if (remaining == 0) {
+					return false;
+				}
+				block.resize(std::min<size_t>(remaining, POSTING_BLOCK));
+				in.read(reinterpret_cast<char*>(block.data()), block.size() * sizeof(appid));
+				remaining -= static_cast<uint32_t>(block.size());
+				pos = 0;
+			}
+			id = block[pos++];
+			return true;
+		}
+	};
+
+	// Appends one appid to out through a POSTING_BLOCK buffer, flush_ids() writes what's left
+	static void write_id(ofstream& out, vector<appid>& block, appid id) {
+		block.push_back(id);
+		if (block.size() == POSTING_BLOCK) {
+			flush_ids(out, block);
+		}
+	}
+
+	static void flush_ids(ofstream& out, vector<appid>& block) {
+		out.write(reinterpret_cast<const char*>(block.data()), block.size() * sizeof(appid));
+		block.clear();
+	}
+
+	void finish() {
+		cout << "Merging segments";
+		for (const string& index : posting_indexes()) {
+			vector<fs::path> segments = merge_passes(index, [this](const vector<fs::path>& in, const fs::path& out) {
+				merge_posting_segments(in, out);
+			});
+			write_dictionary(segments[0], out_dir / (index + ".dict"), out_dir / (index + ".post"));
+			cout << ".";
+		}
+		for (const string& run : sorted_runs()) {
+			vector<fs::path> segments = merge_passes(run, [](const vector<fs::path>& in, const fs::path& out) {
+				merge_sorted_runs(in, out);
+			});
+			fs::rename(segments[0], out_dir / (run + ".run"));
+			cout << ".";
+		}
+		fs::remove_all(out_dir / "segments");
+		cout << "Finished merging segments" << endl;
+	}
+
+	// Merges the segments of one index MAX_MERGE_FAN_IN at a time until a single segment is left
+	template <typename MergeFn>
+	vector<fs::path> merge_passes(const string& index, MergeFn merge) {
+		vector<fs::path> segments;
+		for (size_t s = 0; s < num_segments; ++s) {
+			segments.push_back(segment_path(index, s));
+		}
+		if (segments.empty()) {
+			ofstream(segment_path(index, 0), std::ios::binary);
+			segments.push_back(segment_path(index, 0));
+		}
+
+		size_t pass = 0;
+		while (segments.size() > 1) {
+			vector<fs::path> merged;
+			for (size_t first = 0; first < segments.size(); first += MAX_MERGE_FAN_IN) {
+				vector<fs::path> group(segments.begin() + first, segments.begin() + std::min(first + MAX_MERGE_FAN_IN, segments.size()));
+				fs::path out = out_dir / "segments" / (index + "_pass" + std::to_string(pass) + "_" + std::to_string(merged.size()) + ".seg");
+				merge(group, out);
+				for (const fs::path& p : group) {
+					fs::remove(p);
+				}
+				merged.push_back(out);
+			}
+			segments = std::move(merged);
+			++pass;
+		}
+		return segments;
+	}
+
+	/*
+	* k-way merge of posting segments by key
+	*	Lists with the same key are merged id by id from their readers straight into the output, so a key that
+	*	covers most of the catalog costs one block per segment, not one list. Every row is in one segment, so the
+	*	merged count is the sum of the counts and can be written before the ids.
+	*/
+	static void merge_posting_segments(const vector<fs::path>& inputs, const fs::path& output) {
+		typedef pair<string, size_t> Cursor;			// key, segment
+		typedef pair<appid, size_t> IdCursor;			// next appid, segment
+		vector<PostingReader> readers;
+		readers.reserve(inputs.size());
+		priority_queue<Cursor, vector<Cursor>, std::greater<Cursor>> heap;
+		for (size_t i = 0; i < inputs.size(); ++i) {
+			readers.emplace_back(inputs[i]);
+			if (readers[i].next_list()) {
+				heap.emplace(readers[i].key, i);
+			}
+		}
+
+		ofstream out(output, std::ios::binary);
+		vector<appid> block;
+		block.reserve(POSTING_BLOCK);
+		vector<size_t> lists;
+		while (!heap.empty()) {
+			string key = heap.top().first;
+			uint32_t count = 0;
+			lists.clear();
+			while (!heap.empty() && heap.top().first == key) {
+				lists.push_back(heap.top().second);
+				count += readers[heap.top().second].count;
+				heap.pop();
+			}
+
+			disk_io::write_string(out, key);
+			disk_io::write(out, count);
+			priority_queue<IdCursor, vector<IdCursor>, std::greater<IdCursor>> ids;
+			for (const size_t& segment : lists) {
+				appid id;
+				if (readers[segment].next_id(id)) {
+					ids.emplace(id, segment);
+				}
+			}
+			while (!ids.empty()) {
+				IdCursor c = ids.top();
+				ids.pop();
+				write_id(out, block, c.first);
+				if (readers[c.second].next_id(c.first)) {
+					ids.push(c);
+				}
+			}
+			flush_ids(out, block);
+
+			for (const size_t& segment : lists) {
+				if (readers[segment].next_list()) {
+					heap.emplace(readers[segment].key, segment);
+				}
+			}
+		}
+	}
+
+	static void merge_sorted_runs(const vector<fs::path>& inputs, const fs::path& output) {
+		typedef pair<KeyedRecord, size_t> Cursor;
+		vector<ifstream> in;
+		priority_queue<Cursor, vector<Cursor>, std::greater<Cursor>> heap;
+		for (size_t i = 0; i < inputs.size(); ++i) {
+			in.emplace_back(inputs[i], std::ios::binary);
+			KeyedRecord rec;
+			if (rec.read(in[i])) {
+				heap.emplace(rec, i);
+			}
+		}
+
+		ofstream out(output, std::ios::binary);
+		while (!heap.empty()) {
+			Cursor c = heap.top();
+			heap.pop();
+			c.first.write(out);
+			if (c.first.read(in[c.second])) {
+				heap.push(c);
+			}
+		}
+	}
+
+	// Splits the final merged segment into a dictionary (key, offset, count) and a flat posting file
+	static void write_dictionary(const fs::path& segment, const fs::path& dict_path, const fs::path& post_path) {
+		ofstream dict(dict_path, std::ios::binary);
+		ofstream post(post_path, std::ios::binary);
+		{
+			PostingReader in(segment);
+			vector<appid> block;
+			block.reserve(POSTING_BLOCK);
+			uint64_t offset = 0;
+			while (in.next_list()) {
+				disk_io::write_string(dict, in.key);
+				disk_io::write(dict, offset);
+				disk_io::write(dict, in.count);
+				appid id;
+				while (in.next_id(id)) {
+					write_id(post, block, id);
+				}
+				flush_ids(post, block);
+				offset += in.count;
+			}
+		}
+		fs::remove(segment);
+	}
+};
+
+/*
+* Read side of a StreamingIngest directory
+*	Only the dictionaries stay in memory. Posting lists, sorted runs and names are read from disk per lookup,
+*	runs are binary searched in place.
+*/
+class DiskIndex {
+	struct DictEntry {
+		uint64_t offset;
+		uint32_t count;
+	};
+
+	fs::path dir;
+	map<string, FlatHashMap<DictEntry>> dictionaries; // index name -> normalized key -> posting location
+
+public:
+
+	explicit DiskIndex(const string& dir) : dir(dir) {
+		for (const char* index : { "developers", "publishers", "genres" }) {
+			ifstream in(this->dir / (string(index) + ".dict"), std::ios::binary);
+			FlatHashMap<DictEntry>& dict = dictionaries[index];
+			string key;
+			DictEntry entry;
+			while (disk_io::read_string(in, key) && disk_io::read(in, entry.offset) && disk_io::read(in, entry.count)) {
+				dict.try_emplace(key, entry);
+			}
+		}
+	}
+
+	size_t num_rows() const {
+		return fs::exists(dir / "columns" / "ids.bin") ? fs::file_size(dir / "columns" / "ids.bin") / sizeof(appid) : 0;
+	}
+
+	size_t num_keys(const string& index) const {
+		auto iter = dictionaries.find(index);
+		return (iter == dictionaries.end()) ? 0 : iter->second.size();
+	}
+
+	// Sorted appids for a key of "developers", "publishers" or "genres", matched after Game::normalize_entity
+	vector<appid> postings(const string& index, const string& key) const {
+		vector<appid> ids;
+		auto dict = dictionaries.find(index);
+		if (dict == dictionaries.end()) {
+			return ids;
+		}
+		const DictEntry* found = dict->second.find(Game::normalize_entity(key));
+		if (found == nullptr) {
+			return ids;
+		}
+		const DictEntry& entry = *found;
+		ifstream in(dir / (index + ".post"), std::ios::binary);
+		in.seekg(entry.offset * sizeof(appid));
+		ids.resize(entry.count);
+		in.read(reinterpret_cast<char*>(ids.data()), entry.count * sizeof(appid));
+		return ids;
+	}
+
+	// appids of "release_dates" (yyyymmdd) or "positive_reviews" records with lo <= key <= hi, sorted by key
+	vector<appid> range(const string& run, int64_t lo, int64_t hi) const {
+		ifstream in(dir / (run + ".run"), std::ios::binary);
+		size_t first = lower_bound(in, run_size(run), lo);
+
+		vector<appid> ids;
+		KeyedRecord rec;
+		in.clear();
+		in.seekg(first * KeyedRecord::DISK_BYTES);
+		while (rec.read(in) && rec.key <= hi) {
+			ids.push_back(rec.id);
+		}
+		return ids;
+	}
+
+	string name(appid id) const {
+		ifstream rows(dir / "appid_rows.run", std::ios::binary);
+		size_t i = lower_bound(rows, run_size("appid_rows"), id);
+		KeyedRecord rec;
+		rows.clear();
+		rows.seekg(i * KeyedRecord::DISK_BYTES);
+		if (!rec.read(rows) || rec.key != id) {
+			return "[error]";
+		}
+
+		ifstream offsets(dir / "columns" / "name_offsets.bin", std::ios::binary);
+		uint64_t offset = 0;
+		offsets.seekg(rec.id * sizeof(uint64_t));
+		disk_io::read(offsets, offset);
+
+		ifstream names(dir / "names.bin", std::ios::binary);
+		names.seekg(offset);
+		string result;
+		disk_io::read_string(names, result);
+		return result;
+	}
+
+private:
+
+	size_t run_size(const string& run) const {
+		fs::path file = dir / (run + ".run");
+		return fs::exists(file) ? fs::file_size(file) / KeyedRecord::DISK_BYTES : 0;
+	}
+
+	// First record with key >= target, reading only log2(n) records
+	static size_t lower_bound(ifstream& in, size_t n, int64_t target) {
+		size_t lo = 0;
+		size_t hi = n;
+		KeyedRecord rec;
+		while (lo < hi) {
+			size_t mid = lo + (hi - lo) / 2;
+			in.seekg(mid * KeyedRecord::DISK_BYTES);
+			rec.read(in);
+			if (rec.key < target) {
+				lo = mid + 1;
+			}
+			else {
+				hi = mid;
+			}
+		}
+		return lo;
+	}
+};
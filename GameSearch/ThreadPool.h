@@ -0,0 +1,204 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using std::function;
+using std::unique_ptr;
+using std::vector;
+
+constexpr size_t MORSEL_SIZE = 4096;			// rows handed to a worker per task
+constexpr size_t PARALLEL_THRESHOLD = 2 * MORSEL_SIZE;	// anything smaller stays on the calling thread
+
+/*
+* Work-stealing thread pool
+*	Every worker owns a deque of tasks. A worker pops from the back of its own deque (most recent, still in cache)
+*	and, when that runs dry, steals from the front of somebody else's deque. Callers of parallel_for() help run
+*	tasks while they wait, so nested parallel_for() calls can't deadlock the pool.
+*
+* Methods
+*	shared() - process wide pool sized to the number of cores
+*	submit() - queue a task
+*	parallel_for() - split [begin, end) into morsels and run fn(lo, hi) on each, returns once all are done
+*	run_each() - run fn(i) for i in [0, count) as separate tasks, returns once all are done
+*/
+class ThreadPool {
+	struct WorkQueue {
+		std::mutex lock;
+		std::deque<function<void()>> tasks;
+	};
+
+	vector<unique_ptr<WorkQueue>> queues;
+	vector<std::thread> workers;
+
+	std::mutex sleep_lock;
+	std::condition_variable wake;
+	std::atomic<size_t> queued{ 0 };
+	std::atomic<size_t> next_queue{ 0 };
+	bool stopping = false;
+
+	static size_t& worker_index() {
+		static thread_local size_t index = SIZE_MAX; // SIZE_MAX = not a pool thread
+		return index;
+	}
+
+public:
+
+	explicit ThreadPool(size_t num_threads = std::thread::hardware_concurrency()) {
+		// the calling thread helps out in parallel_for(), so one less worker than cores
+		size_t num_workers = (num_threads > 1) ? num_threads - 1 : 0;
+		for (size_t i = 0; i < std::max<size_t>(num_workers, 1); ++i) {
+			queues.push_back(std::make_unique<WorkQueue>());
+		}
+		for (size_t i = 0; i < num_workers; ++i) {
+			workers.emplace_back([this, i] { worker_loop(i); });
+		}
+	}
+
+	~ThreadPool() {
+		{
+			std::lock_guard<std::mutex> guard(sleep_lock);
+			stopping = true;
+		}
+		wake.notify_all();
+		for (std::thread& t : workers) {
+			t.join();
+		}
+	}
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	static ThreadPool& shared() {
+		static ThreadPool pool;
+		return pool;
+	}
+
+	size_t num_workers() const {
+		return workers.size();
+	}
+
+	void submit(function<void()> task) {
+		// pool threads push onto their own deque, everyone else round robins
+		size_t q = (worker_index() < queues.size()) ? worker_index() : next_queue++ % queues.size();
+		{
+			std::lock_guard<std::mutex> guard(queues[q]->lock);
+			queues[q]->tasks.push_back(std::move(task));
+		}
+		{
+			std::lock_guard<std::mutex> guard(sleep_lock);
+			++queued;
+		}
+		wake.notify_one();
+	}
+
+	// Runs a single queued task on the calling thread if there is one
+	bool run_one() {
+		function<void()> task;
+		if (!try_pop(task)) {
+			return false;
+		}
+		task();
+		return true;
+	}
+
+	// fn is called as fn(lo, hi) for every morsel of [begin, end), morsels may run in any order
+	template <typename Fn>
+	void parallel_for(size_t begin, size_t end, size_t morsel, Fn&& fn) {
+		if (end <= begin) {
+			return;
+		}
+		morsel = std::max<size_t>(morsel, 1);
+		if (workers.empty() || end - begin < PARALLEL_THRESHOLD || end - begin <= morsel) {
+			fn(begin, end); // small queries don't pay for the hand-off
+			return;
+		}
+
+		run_each((end - begin + morsel - 1) / morsel, [&](size_t m) {
+			size_t lo = begin + m * morsel;
+			fn(lo, std::min(lo + morsel, end));
+		});
+	}
+
+	// fn(i) for every i in [0, count), each call is its own task no matter how small (shards, files...)
+	template <typename Fn>
+	void run_each(size_t count, Fn&& fn) {
+		std::atomic<size_t> remaining{ count };
+		std::exception_ptr error;
+		std::mutex error_lock;
+
+		for (size_t i = 0; i < count; ++i) {
+			submit([&, i] {
+				try {
+					fn(i);
+				}
+				catch (...) {
+					std::lock_guard<std::mutex> guard(error_lock);
+					if (!error) {
+						error = std::current_exception();
+					}
+				}
+				--remaining;
+			});
+		}
+
+		while (remaining > 0) {
+			if (!run_one()) {
+				std::this_thread::yield();
+			}
+		}
+
+		if (error) {
+			std::rethrow_exception(error);
+		}
+	}
+
+private:
+
+	bool try_pop(function<void()>& task) {
+		size_t self = worker_index();
+		size_t start = (self < queues.size()) ? self : 0;
+
+		// own deque first (LIFO), then steal from the others (FIFO)
+		for (size_t i = 0; i < queues.size(); ++i) {
+			WorkQueue& q = *queues[(start + i) % queues.size()];
+			std::lock_guard<std::mutex> guard(q.lock);
+			if (q.tasks.empty()) {
+				continue;
+			}
+			if (i == 0 && self < queues.size()) {
+				task = std::move(q.tasks.back());
+				q.tasks.pop_back();
+			}
+			else {
+				task = std::move(q.tasks.front());
+				q.tasks.pop_front();
+			}
+			--queued;
+			return true;
+		}
+		return false;
+	}
+
+	void worker_loop(size_t index) {
+		worker_index() = index;
+		while (true) {
+			if (run_one()) {
+				continue;
+			}
+			std::unique_lock<std::mutex> guard(sleep_lock);
+			wake.wait(guard, [this] { return stopping || queued > 0; });
+			if (stopping && queued == 0) {
+				return;
+			}
+		}
+	}
+};
@@ -1,6 +1,10 @@
 #include "Date.h"
 #include "GameDescriptors.h"
 #include "GameLibrary.h"
+#include "ResultWriter.h"
+#include "SelfCheck.h"
+#include "ShardedLibrary.h"
+#include "StreamingIngest.h"
 
 using std::cin;
 
@@ -14,11 +18,15 @@ void print_str_list(const vector<string>& list) {
 void display_search_terms(const GameLibrary& lib) {
 	string input;
 	int choice = 0;
+	// counted up front, a lazy library may still print while building these indexes
+	size_t num_developers = lib.get_developers_list().size();
+	size_t num_publishers = lib.get_publishers_list().size();
+	size_t num_genres = lib.get_genre_types().size();
 	cout << "Would you like to view:" << endl;
 	cout << "  1. Date Boundaries" << endl;
-	cout << "  2. List of Developers (" << lib.get_developers_list().size() << " items)" << endl;
-	cout << "  3. List of Publishers (" << lib.get_publishers_list().size() << " items)" << endl;
-	cout << "  4. List of Genres (" << lib.get_genre_types().size() << " items)" << endl;
+	cout << "  2. List of Developers (" << num_developers << " items)" << endl;
+	cout << "  3. List of Publishers (" << num_publishers << " items)" << endl;
+	cout << "  4. List of Genres (" << num_genres << " items)" << endl;
 	cout << "Enter a number: ";
 
 
@@ -33,9 +41,9 @@ void display_search_terms(const GameLibrary& lib) {
 	while (choice < 1 || choice > 4) {
 		cout << "Incorrect choice selected. Would you like to view:" << endl;
 		cout << "  1. Date Boundaries" << endl;
-		cout << "  2. List of Developers (" << lib.get_developers_list().size() << " items)" << endl;
-		cout << "  3. List of Publishers (" << lib.get_publishers_list().size() << " items)" << endl;
-		cout << "  4. List of Genres (" << lib.get_genre_types().size() << " items)" << endl;
+		cout << "  2. List of Developers (" << num_developers << " items)" << endl;
+		cout << "  3. List of Publishers (" << num_publishers << " items)" << endl;
+		cout << "  4. List of Genres (" << num_genres << " items)" << endl;
 		cout << "Enter a number: ";
 
 		try {
@@ -66,9 +74,35 @@ void display_search_terms(const GameLibrary& lib) {
 	}
 }
 
+// yyyymmdd of a date bound typed at the prompt, an unreadable date leaves that end of the range open
+int32_t parse_date_bound(const string& s_date, int32_t open_end) {
+	try {
+		return GameColumns::to_ymd(Date(s_date));
+	}
+	catch (exception& e) {
+		cout << "invalid date: " << e.what() << ". Will switch to default " << (open_end == INT32_MIN ? "minimum" : "maximum") << " date" << endl;
+		return open_end;
+	}
+}
+
+// Same messages the per-term searches print for a developer, publisher or genre that isn't in the catalog
+void report_unknown_keywords(const GameLibrary& lib, const GameQuery& query) {
+	if (!query.developer.empty() && lib.get_index(Facet::Developer).find(query.developer) == nullptr) {
+		cout << "No developers called \"" << query.developer << "\" found!" << endl;
+	}
+	if (!query.publisher.empty() && lib.get_index(Facet::Publisher).find(query.publisher) == nullptr) {
+		cout << "No publishers called \"" << query.publisher << "\" found!" << endl;
+	}
+	for (const string& genre : query.genres) {
+		if (lib.get_index(Facet::Genre).find(genre) == nullptr) {
+			cout << "No genres called \"" << genre << "\" found!" << endl;
+		}
+	}
+}
+
 void search_for_game(GameLibrary& lib) {
-	vector<string> search_terms = {"  Date Bounds (enter two dates separated by a space, format yyyy-mm-dd): ", "  Developer: ", "  Publisher: ", "  Genre: ", "  Number of Positive Reviews: "};
-	vector<string> user_input; // this will only have 4 elements
+	vector<string> search_terms = {"  Date Bounds (enter two dates separated by a space, format yyyy-mm-dd): ", "  Developer: ", "  Publisher: ", "  Genre (separate several with ';'): ", "  Number of Positive Reviews: ", "  Minimum % of Positive Reviews: ", "  Maximum Price (e.g. 9.99): ", "  Minimum Owners (e.g. 1000000): ", "  Query (e.g. genre:Strategy AND NOT genre:Early Access): ", "  Similar to (game name): "};
+	vector<string> user_input; // this will only have 10 elements
 	string tmp;
 
 	getline(cin, tmp); //clears previous cin or something, results in first item in search_terms being skipped if this line is deleted
@@ -104,28 +138,73 @@ void search_for_game(GameLibrary& lib) {
 
 
 
-	// Vector method
-	vector<set<appid>> search_sets;
-	// hard coded for simplicity, won't get out of bounds error since each item is either an empty string or a string
-	if (!user_input[0].empty()) {
-		string date1 = user_input[0].substr(0, user_input[0].find(' '));
-		string date2 = user_input[0].substr(user_input[0].find(' ') + 1);
-		search_sets.push_back(std::move(lib.search_by_date(date1, date2)));
-	}
-	if (!user_input[1].empty()) {
-		search_sets.push_back(std::move(lib.search_by_developer(user_input[1])));
-
+	// Conjunctive terms go into one query, run as a single fused pass over the columns
+	GameQuery query;
+	try {
+		// hard coded for simplicity, won't get out of bounds error since each item is either an empty string or a string
+		if (!user_input[0].empty()) {
+			query.terms.has_date = true;
+			query.terms.date_lo = parse_date_bound(user_input[0].substr(0, user_input[0].find(' ')), INT32_MIN);
+			query.terms.date_hi = parse_date_bound(user_input[0].substr(user_input[0].find(' ') + 1), INT32_MAX);
+		}
+		if (!user_input[4].empty()) {
+			query.terms.has_min_positive = true;
+			query.terms.min_positive = stoi(user_input[4]);
+		}
+		if (!user_input[5].empty()) {
+			query.terms.has_ratio = true;
+			query.terms.min_percent = stoi(user_input[5]);
+		}
+		if (!user_input[6].empty()) {
+			// price and owners are answered from their range indexes when they're selective
+			query.terms.has_price = true;
+			query.terms.price_hi = GameColumns::to_cents(user_input[6]);
+		}
+		if (!user_input[7].empty()) {
+			query.terms.has_min_owners = true;
+			query.terms.min_owners = stoi(user_input[7]);
+		}
 	}
-	if (!user_input[2].empty()) {
-		search_sets.push_back(std::move(lib.search_by_publisher(user_input[2])));
+	catch (exception& e) {
+		cout << "Incorrect Parameters: " << e.what() << endl;
+		return;
 	}
+	query.developer = user_input[1];
+	query.publisher = user_input[2];
 	if (!user_input[3].empty()) {
-		search_sets.push_back(std::move(lib.search_by_genre(user_input[3])));
+		// "Action;Indie" means tagged with both
+		query.genres = Game::process_tags(user_input[3]);
 	}
-	if (!user_input[4].empty()) {
-		search_sets.push_back(std::move(lib.search_by_positive_reviews(user_input[4])));
+	report_unknown_keywords(lib, query);
+	bool has_terms = query.terms.has_date || query.terms.has_min_positive || query.terms.has_ratio || query.terms.has_price
+		|| query.terms.has_min_owners || !query.developer.empty() || !query.publisher.empty() || !query.genres.empty();
+
+	vector<set<appid>> search_sets;
+	if (has_terms) {
+		search_sets.push_back(lib.search(query.bind(lib)));
 	}
 
+	if (!user_input[8].empty()) {
+		// AND, OR and NOT over genres, developers and publishers
+		search_sets.push_back(std::move(lib.search_by_query(user_input[8])));
+	}
+
+	if (!user_input[9].empty()) {
+		// the other terms become a filter on the recommendations instead of a result of their own
+		vector<appid> ids = lib.find_by_name(user_input[9]);
+		if (ids.empty()) {
+			cout << "No games called \"" << user_input[9] << "\" found!" << endl;
+			return;
+		}
+		set<appid> allowed;
+		if (!search_sets.empty()) {
+			allowed = GameLibrary::merge_n_sets(search_sets);
+		}
+		for (const SimilarGame& game : lib.search_similar(ids[0], 10, search_sets.empty() ? nullptr : &allowed)) {
+			cout << lib.get_name(game.id) << " (" << static_cast<int>(game.similarity * 100 + 0.5) << "% similar)" << endl;
+		}
+		return;
+	}
 
 	if (search_sets.empty()) {
 		cout << "No games found!" << endl;
@@ -135,17 +214,321 @@ void search_for_game(GameLibrary& lib) {
 	set<appid> union_set;
 	union_set = std::move(GameLibrary::merge_n_sets(search_sets));
 
-	for (const auto& elem : union_set) {
-		cout << lib.get_name(elem) << endl;
+	ResultWriter writer(cout, OutputFormat::Text, { ResultColumn::Name });
+	writer.write(lib, lib.rows_of(union_set));
+
+}
+
+
+// game_search --ingest <csv> <output dir> [rows per chunk]
+int ingest(int argc, char** argv) {
+	if (argc < 4) {
+		cout << "Usage: " << argv[0] << " --ingest <csv> <output dir> [rows per chunk]" << endl;
+		return 1;
+	}
+
+	size_t chunk_rows = DEFAULT_CHUNK_ROWS;
+	if (argc > 4) {
+		try {
+			chunk_rows = std::stoul(argv[4]);
+		}
+		catch (exception& e) {
+			cout << "Invalid chunk size: " << e.what() << endl;
+			return 1;
+		}
+	}
+
+	try {
+		StreamingIngest(argv[2], argv[3], chunk_rows).run();
+	}
+	catch (exception& e) {
+		cout << "Ingest failed: " << e.what() << endl;
+		return 1;
 	}
 
+	DiskIndex index(argv[3]);
+	cout << index.num_rows() << " games, " << index.num_keys("developers") << " developers, "
+		<< index.num_keys("publishers") << " publishers, " << index.num_keys("genres") << " genres" << endl;
+	return 0;
 }
 
+// Same prompts as search_for_game(), answered by every shard, plus the best rated matches and their top genres
+void sharded_search(ShardedLibrary& lib) {
+	vector<string> search_terms = {"  Date Bounds (enter two dates separated by a space, format yyyy-mm-dd): ", "  Developer: ", "  Publisher: ", "  Genre (separate several with ';'): ", "  Number of Positive Reviews: ", "  Minimum % of Positive Reviews: "};
+	vector<string> user_input;
+	string tmp;
 
-int main() {
-	cout << "Welcome to Steam Game Search" << endl;
+	getline(cin, tmp); // clears the newline left by cin >>
+
+	for (const string& term : search_terms) {
+		cout << term;
+		getline(cin, tmp);
+		user_input.push_back(tmp);
+	}
+
+	GameQuery query;
+	try {
+		if (!user_input[0].empty()) {
+			query.terms.has_date = true;
+			query.terms.date_lo = GameColumns::to_ymd(Date(user_input[0].substr(0, user_input[0].find(' '))));
+			query.terms.date_hi = GameColumns::to_ymd(Date(user_input[0].substr(user_input[0].find(' ') + 1)));
+		}
+		if (!user_input[4].empty()) {
+			query.terms.has_min_positive = true;
+			query.terms.min_positive = stoi(user_input[4]);
+		}
+		if (!user_input[5].empty()) {
+			query.terms.has_ratio = true;
+			query.terms.min_percent = stoi(user_input[5]);
+		}
+	}
+	catch (exception& e) {
+		cout << "Incorrect Parameters: " << e.what() << endl;
+		return;
+	}
+	query.developer = user_input[1];
+	query.publisher = user_input[2];
+	if (!user_input[3].empty()) {
+		query.genres = Game::process_tags(user_input[3]);
+	}
+
+	{
+		ResultWriter writer(cout, OutputFormat::Text, { ResultColumn::Name });
+		if (lib.write(query, writer) == 0) {
+			cout << "No games found!" << endl;
+			return;
+		}
+	}
+
+	cout << "Most positive reviews:" << endl;
+	for (const RankedGame& game : lib.top_k(query, 5)) {
+		cout << "  " << lib.get_name(game.id) << " (" << game.score << ")" << endl;
+	}
+	cout << "Top genres:" << endl;
+	for (const auto& facet : lib.facet_counts(query, Facet::Genre, 5)) {
+		cout << "  " << facet.first << " (" << facet.second << ")" << endl;
+	}
+}
+
+// game_search --shards <n> [processes]
+int sharded(int argc, char** argv) {
+	size_t num_shards = 0;
+	try {
+		num_shards = (argc > 2) ? std::stoul(argv[2]) : 0;
+	}
+	catch (exception& e) {
+		cout << "Invalid number of shards: " << e.what() << endl;
+	}
+	if (num_shards == 0) {
+		cout << "Usage: " << argv[0] << " --shards <n> [processes]" << endl;
+		return 1;
+	}
+	ShardExecution execution = (argc > 3 && string(argv[3]) == "processes") ? ShardExecution::Processes : ShardExecution::Threads;
+	ShardedLibrary library(num_shards, ShardBy::IdRange, execution);
+
+	int choice = 0;
+	string input;
+	while (choice != 2) {
+		cout << "  1. Search for a game" << endl;
+		cout << "  2. Exit" << endl;
+		cout << "Enter a number: ";
+		if (!(cin >> input)) {
+			break;
+		}
+		try {
+			choice = stoi(input);
+		}
+		catch (exception& e) {
+			cout << "Error, invalid input: " << e.what() << endl;
+			continue;
+		}
+		if (choice == 1) {
+			sharded_search(library);
+		}
+	}
+	return 0;
+}
+
+// game_search --stats <genre|developer|publisher> <value> [year]: releases per year, or per month of one year
+int stats(int argc, char** argv) {
+	if (argc < 4) {
+		cout << "Usage: " << argv[0] << " --stats <genre|developer|publisher> <value> [year]" << endl;
+		return 1;
+	}
+	string dimension = argv[2];
+	if (dimension != "genre" && dimension != "developer" && dimension != "publisher") {
+		cout << "Unknown dimension \"" << dimension << "\"" << endl;
+		cout << "Usage: " << argv[0] << " --stats <genre|developer|publisher> <value> [year]" << endl;
+		return 1;
+	}
+	Facet facet = (dimension == "developer") ? Facet::Developer : (dimension == "publisher") ? Facet::Publisher : Facet::Genre;
+
+	uint16_t lo = 0;
+	uint16_t hi = UINT16_MAX;
+	AggregateCube::Granularity granularity = AggregateCube::Granularity::Year;
+	if (argc > 4) {
+		try {
+			unsigned int year = std::stoul(argv[4]);
+			lo = AggregateCube::period(year, 1);
+			hi = AggregateCube::period(year, 12);
+			granularity = AggregateCube::Granularity::Month;
+		}
+		catch (exception& e) {
+			cout << "Invalid year: " << e.what() << endl;
+			return 1;
+		}
+	}
 
 	GameLibrary library;
+	auto start = std::chrono::steady_clock::now();
+	vector<pair<uint16_t, Aggregate>> series = library.get_cube().series(facet, argv[3], lo, hi, granularity);
+	auto end = std::chrono::steady_clock::now();
+	std::chrono::duration<double> elapsed_seconds = end - start;
+	cout << "Cube query took: " << elapsed_seconds.count() << "s" << endl;
+
+	if (series.empty()) {
+		cout << "No games found!" << endl;
+		return 0;
+	}
+	for (const auto& entry : series) {
+		const Aggregate& a = entry.second;
+		cout << AggregateCube::year_of(entry.first);
+		if (granularity == AggregateCube::Granularity::Month) {
+			cout << "-" << AggregateCube::month_of(entry.first);
+		}
+		cout << ": " << a.count << " games, positive ratings mean " << static_cast<long long>(a.mean(a.positive))
+			<< " ~median " << static_cast<long long>(a.positive_median()) << " max " << a.positive.max
+			<< ", price " << a.price_cents.min / 100.0 << "-" << a.price_cents.max / 100.0 << endl;
+	}
+	return 0;
+}
+
+// game_search --export <text|jsonl|binary> <file> <query> [columns]: every game matching a boolean query
+int export_results(int argc, char** argv) {
+	if (argc < 5) {
+		cout << "Usage: " << argv[0] << " --export <text|jsonl|binary> <file> <query> [appid,name,release_date,positive_ratings,negative_ratings,owners,price]" << endl;
+		return 1;
+	}
+	OutputFormat format;
+	vector<ResultColumn> columns = { ResultColumn::Appid, ResultColumn::Name };
+	try {
+		format = ResultWriter::parse_format(argv[2]);
+		if (argc > 5) {
+			columns = ResultWriter::parse_columns(argv[5]);
+		}
+	}
+	catch (exception& e) {
+		cout << "Incorrect Parameters: " << e.what() << endl;
+		return 1;
+	}
+
+	GameLibrary library;
+	vector<uint32_t> rows = library.rows_of(library.search_by_query(argv[4]));
+
+	auto start = std::chrono::steady_clock::now();
+	ofstream out(argv[3], std::ios::binary);
+	if (!out) {
+		cout << "Could not open " << argv[3] << " for writing" << endl;
+		return 1;
+	}
+	ResultWriter writer(out, format, columns);
+	writer.write(library, rows);
+	writer.flush();
+	if (!out) {
+		cout << "Could not write " << argv[3] << endl;
+		return 1;
+	}
+	auto end = std::chrono::steady_clock::now();
+	std::chrono::duration<double> elapsed_seconds = end - start;
+	cout << "Exported " << writer.num_rows() << " games in: " << elapsed_seconds.count() << "s" << endl;
+	return 0;
+}
+
+// game_search --reload <csv>: loads the catalog, then applies a newer dump of it and reports what changed
+int reload_catalog(int argc, char** argv) {
+	if (argc < 3) {
+		cout << "Usage: " << argv[0] << " --reload <csv>" << endl;
+		return 1;
+	}
+
+	GameLibrary library;
+	ReloadStats stats;
+	try {
+		stats = library.reload(argv[2]);
+	}
+	catch (exception& e) {
+		cout << "Reload failed: " << e.what() << endl;
+		return 1;
+	}
+	cout << "Reload took: " << stats.seconds << "s" << endl;
+	cout << "  " << stats.inserted << " inserted, " << stats.updated << " updated, " << stats.deleted << " deleted, "
+		<< stats.unchanged << " unchanged" << endl;
+	cout << "  " << stats.lists_rewritten << " developer/publisher/genre lists rewritten" << endl;
+	return 0;
+}
+
+// game_search --selfcheck [queries] [seed]: every engine against the reference evaluator, exits 1 on a mismatch
+int self_check(int argc, char** argv) {
+	size_t num_queries = SELFCHECK_QUERIES;
+	uint32_t seed = 1;
+	try {
+		if (argc > 2) {
+			num_queries = std::stoul(argv[2]);
+		}
+		if (argc > 3) {
+			seed = static_cast<uint32_t>(std::stoul(argv[3]));
+		}
+	}
+	catch (exception& e) {
+		cout << "Usage: " << argv[0] << " --selfcheck [queries] [seed]" << endl;
+		return 1;
+	}
+	return SelfCheck(num_queries, seed).run() ? 0 : 1;
+}
+
+// game_search --memory: bytes per index before and after compacting
+int memory_report() {
+	GameLibrary library;
+	MemoryReport standard = library.memory_report();
+	library.compact();
+	MemoryReport compact = library.memory_report();
+
+	cout << "Standard library:" << endl;
+	standard.print(cout);
+	cout << "Compact library:" << endl;
+	compact.print(cout);
+	return 0;
+}
+
+int main(int argc, char** argv) {
+	string option = (argc > 1) ? argv[1] : "";
+	if (option == "--ingest") {
+		return ingest(argc, argv);
+	}
+	if (option == "--memory") {
+		return memory_report();
+	}
+	if (option == "--stats") {
+		return stats(argc, argv);
+	}
+	if (option == "--shards") {
+		return sharded(argc, argv);
+	}
+	if (option == "--export") {
+		return export_results(argc, argv);
+	}
+	if (option == "--reload") {
+		return reload_catalog(argc, argv);
+	}
+	if (option == "--selfcheck") {
+		return self_check(argc, argv);
+	}
+
+	cout << "Welcome to Steam Game Search" << endl;
+
+	// --compact trades the raw rows for a smaller footprint, searches behave the same
+	// otherwise indexes are built on first use and warmed in the background, so the menu comes up right away
+	GameLibrary library(option == "--compact" ? LibraryMode::Compact : LibraryMode::Lazy);
 
 	int choice = 0;
 	string input;